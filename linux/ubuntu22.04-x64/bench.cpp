@@ -0,0 +1,737 @@
+/**
+ * @file bench.cpp
+ * @brief Non-interactive latency benchmark for predict, regist, save, load and delete (Linux version)
+ * @note Build: g++ -std=c++11 bench.cpp smart_predictor.cpp jpeg_prep.cpp predictor_stream.cpp predictor_cascade.cpp -o bench -ldl -pthread -ljpeg
+ *
+ * Usage: ./bench <image_dir> [--threads N] [--iterations N] [--slow-iterations N] [--compact-cap N]
+ *                [--prep-min-side N] [--roi X,Y,W,H] [--sdk-threads N] [--cpus LIST]
+ *                [--spin active|passive] [--thread-sweep LIST] [--cascade-margins LIST]
+ *                [--gallery-sizes LIST] [--model DIR]
+ *
+ * image_dir holds one sub-directory per label with the images of that label,
+ * e.g. image_dir/apple/1.jpg. The model directory is copied to a scratch
+ * directory first, so the benchmark never changes the real gallery.
+ * SMART_PREDICTOR_MODEL_TYPE selects the model variant.
+ * Results are written to stdout as JSON. The last phase compacts the gallery
+ * to --compact-cap entries per label and compares model size, memory,
+ * predict latency and top-1 accuracy over the corpus before and after.
+ * The scratch copy's entries of the corpus labels are deleted before the
+ * regist phase, so the entry store tracks those labels in full and the
+ * compaction can rebuild them.
+ * The input_sizes section groups the corpus by frame size and compares
+ * predicting the original JPEG with predicting it after prepareJpeg()
+ * (DCT-scaled to --prep-min-side and cropped to --roi), including the
+ * peak resident memory each adds. The stream section feeds the corpus as a
+ * camera stream that holds each image still and compares the CPU time of
+ * predicting every frame with a gated stream session; a cpu_reduction
+ * above 1 means gating pays off for this SDK and frame size.
+ * --sdk-threads, --cpus and --spin configure the inference threads for the
+ * whole run (see predictorConfigureThreads); --thread-sweep, e.g. 1,2,4,
+ * repeats the predict phase at each inference thread count. The sweep can
+ * only change the count in-process when the SDK runs on OpenMP; otherwise
+ * its rows report "applied": false and separate runs with --sdk-threads
+ * are needed.
+ * The cascade section predicts the corpus through predictCascade at each
+ * of --cascade-margins and reports how often the first stage answered,
+ * the latency, and top-1 agreement with full-resolution prediction.
+ * --gallery-sizes, e.g. 1000,10000,100000, runs last: it fills the scratch
+ * gallery to each size and reports predict latency, memory and the saved
+ * size per entry, the baseline an indexed gallery search would be judged by.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <ctime>
+#include <dlfcn.h>
+
+#include "smart_predictor.h"
+#include "jpeg_prep.h"
+#include "predictor_stream.h"
+#include "predictor_cascade.h"
+
+// Configuration parameters
+const char* DEFAULT_MODEL_DIR = "./model";
+const int MODEL_TYPE = modelTypeFromEnv();  // model_type of SmartPredictor_load, see modelTypeFromEnv()
+float PREDICTION_THRESHOLD = 0.3f;
+const int GROWTH_STEPS = 5;  // Gallery sizes sampled while the regist phase runs
+const int GROWTH_PREDICTIONS = 20;  // Predictions timed at each sampled gallery size
+const int DEFAULT_COMPACT_CAP = 5;  // Entries kept per label by the compaction phase
+const int SIZE_PREDICTIONS = 10;  // Predictions timed per frame size and path in the input_sizes phase
+const int STREAM_HOLD_FRAMES = 30;  // Frames each corpus image stays in view in the stream phase
+const int SWEEP_WARMUP = 5;  // Untimed predictions after each thread count change
+const float DEFAULT_CASCADE_MARGINS[] = { 0.05f, 0.1f, 0.15f, 0.25f };  // Margins tried by the cascade phase
+const int SCALE_LABELS = 100;  // Synthetic labels the gallery_scale entries are spread over
+
+// One labelled image of the corpus
+struct CorpusImage {
+    std::string label;
+    std::vector<unsigned char> bytes;
+};
+
+// Latencies of one operation type
+struct OpStats {
+    std::vector<double> latenciesMs;
+    int errors;
+    double wallMs;
+};
+
+// Function declarations
+std::vector<CorpusImage> readCorpus(const std::string& dir);
+OpStats runParallel(int count, int threads, double (*op)(int index));
+void printOp(const char* name, const OpStats& stats, bool last);
+std::string measureGallery();
+long long lockedDirectorySize(const std::string& dir);
+std::vector<std::string> measureInputSizes(const PrepOptions& options);
+std::string measureStream();
+std::vector<std::string> sweepThreads(const std::vector<int>& counts, ThreadConfig config, int iterations, int threads);
+std::vector<std::string> sweepCascade(const std::vector<float>& margins, const PrepOptions& prep);
+std::vector<std::string> measureGalleryScale(const std::vector<int>& sizes);
+int topLabel(const PredictScore* scores, int scoreCount);
+bool parseCountList(const char* text, std::vector<int>* counts);
+
+std::vector<CorpusImage> corpus;
+SmartPredictor* handle = nullptr;
+std::string scratch_dir;
+
+// Time one SDK call; returns its latency in ms, or -1 if it failed
+template <typename Call>
+double timeCall(Call call) {
+    auto start = std::chrono::high_resolution_clock::now();
+    bool ok = call();
+    auto end = std::chrono::high_resolution_clock::now();
+    return ok ? std::chrono::duration<double, std::milli>(end - start).count() : -1.0;
+}
+
+double predictOp(int index) {
+    CorpusImage& image = corpus[index % corpus.size()];
+    char buffer[4096];
+    return timeCall([&] {
+        return predictorPredict(handle, image.bytes.data(), static_cast<long>(image.bytes.size()),
+                                PREDICTION_THRESHOLD, buffer, sizeof(buffer)) >= 0;
+    });
+}
+
+double registOp(int index) {
+    CorpusImage& image = corpus[index % corpus.size()];
+    return timeCall([&] {
+        return predictorRegist(handle, image.bytes.data(), static_cast<long>(image.bytes.size()),
+                               image.label.c_str(), 6) >= 0;
+    });
+}
+
+double saveOp(int) {
+    return timeCall([] { return predictorSave(handle) >= 0; });
+}
+
+double loadOp(int) {
+    predictorDestroy(handle);
+    return timeCall([] {
+        handle = predictorCreate(scratch_dir.c_str(), MODEL_TYPE);
+        return handle != nullptr;
+    });
+}
+
+// Registers a throw-away label first; only the delete is timed
+double deleteOp(int index) {
+    std::string label = "__bench_delete_" + std::to_string(index);
+    CorpusImage& image = corpus[index % corpus.size()];
+    predictorRegist(handle, image.bytes.data(), static_cast<long>(image.bytes.size()), label.c_str(), 6);
+    return timeCall([&] { return predictorDelete(handle, label.c_str()); });
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <image_dir> [--threads N] [--iterations N] [--slow-iterations N] [--compact-cap N]"
+                  << " [--prep-min-side N] [--roi X,Y,W,H] [--sdk-threads N] [--cpus LIST] [--spin active|passive]"
+                  << " [--thread-sweep LIST] [--cascade-margins LIST] [--gallery-sizes LIST] [--model DIR]"
+                  << std::endl;
+        return -1;
+    }
+    std::string imageDir = argv[1];
+    std::string modelDir = DEFAULT_MODEL_DIR;
+    int threads = 1;
+    int iterations = 200;
+    int slowIterations = 5;  // Save, load and delete are far slower than predict
+    int compactCap = DEFAULT_COMPACT_CAP;
+    PrepOptions prep = { PREP_MIN_SIDE, { 0, 0, 0, 0 }, PREP_QUALITY };
+    ThreadConfig threadConfig = { 0, std::vector<int>(), SPIN_DEFAULT };
+    std::vector<int> sweep;
+    std::vector<int> gallerySizes;
+    std::vector<float> margins(DEFAULT_CASCADE_MARGINS,
+                               DEFAULT_CASCADE_MARGINS + sizeof(DEFAULT_CASCADE_MARGINS) / sizeof(DEFAULT_CASCADE_MARGINS[0]));
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--threads") {
+            threads = std::max(1, std::atoi(argv[i + 1]));
+        } else if (option == "--iterations") {
+            iterations = std::max(1, std::atoi(argv[i + 1]));
+        } else if (option == "--slow-iterations") {
+            slowIterations = std::max(1, std::atoi(argv[i + 1]));
+        } else if (option == "--compact-cap") {
+            compactCap = std::max(1, std::atoi(argv[i + 1]));
+        } else if (option == "--prep-min-side") {
+            prep.minSide = std::max(1, std::atoi(argv[i + 1]));
+        } else if (option == "--roi") {
+            PrepRegion& roi = prep.roi;
+            if (std::sscanf(argv[i + 1], "%d,%d,%d,%d", &roi.x, &roi.y, &roi.width, &roi.height) != 4) {
+                std::cerr << "Invalid region: " << argv[i + 1] << std::endl;
+                return -1;
+            }
+        } else if (option == "--sdk-threads") {
+            threadConfig.threads = std::max(0, std::atoi(argv[i + 1]));
+        } else if (option == "--cpus") {
+            if (!parseCpuList(argv[i + 1], &threadConfig.cpus)) {
+                std::cerr << "Invalid CPU list: " << argv[i + 1] << std::endl;
+                return -1;
+            }
+        } else if (option == "--spin") {
+            std::string policy = argv[i + 1];
+            threadConfig.spin = policy == "active" ? SPIN_ACTIVE : policy == "passive" ? SPIN_PASSIVE : SPIN_DEFAULT;
+        } else if (option == "--thread-sweep") {
+            if (!parseCountList(argv[i + 1], &sweep)) {
+                std::cerr << "Invalid thread counts: " << argv[i + 1] << std::endl;
+                return -1;
+            }
+        } else if (option == "--cascade-margins") {
+            margins.clear();
+            for (char* cursor = argv[i + 1]; *cursor;) {
+                char* end = nullptr;
+                margins.push_back(std::strtof(cursor, &end));
+                if (end == cursor || (*end && *end != ',')) {
+                    std::cerr << "Invalid margins: " << argv[i + 1] << std::endl;
+                    return -1;
+                }
+                cursor = *end ? end + 1 : end;
+            }
+        } else if (option == "--gallery-sizes") {
+            if (!parseCountList(argv[i + 1], &gallerySizes)) {
+                std::cerr << "Invalid gallery sizes: " << argv[i + 1] << std::endl;
+                return -1;
+            }
+        } else if (option == "--model") {
+            modelDir = argv[i + 1];
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return -1;
+        }
+    }
+
+    if (!predictorConfigureThreads(threadConfig)) {
+        std::cerr << "Invalid thread configuration" << std::endl;
+        return -1;
+    }
+    if (!loadLibrary()) {
+        std::cerr << "Failed to load library: " << dlerror() << std::endl;
+        return -1;
+    }
+    if (!getFunctionPointers()) {
+        std::cerr << "Failed to get all required function pointers" << std::endl;
+        return -1;
+    }
+
+    try {
+        corpus = readCorpus(imageDir);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+    if (corpus.empty()) {
+        std::cerr << "No images found in " << imageDir << std::endl;
+        return -1;
+    }
+
+    char scratch[] = "/tmp/rx_bench_XXXXXX";
+    if (!mkdtemp(scratch) || !copyDirectory(modelDir, scratch)) {
+        std::cerr << "Failed to copy " << modelDir << " to a scratch directory" << std::endl;
+        return -1;
+    }
+    scratch_dir = scratch;
+    if (!predictorEnableEntryStore(scratch_dir.c_str())) {
+        std::cerr << "Failed to enable the entry store" << std::endl;
+        removeDirectory(scratch_dir);
+        return -1;
+    }
+
+    OpStats load = runParallel(1, 1, loadOp);
+    if (!handle) {
+        std::cerr << "Failed to load model" << std::endl;
+        removeDirectory(scratch_dir);
+        return -1;
+    }
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        if (i == 0 || corpus[i].label != corpus[i - 1].label) {
+            predictorDelete(handle, corpus[i].label.c_str());
+        }
+    }
+
+    // Regist in steps and sample predict latency as the gallery grows
+    OpStats regist = { std::vector<double>(), 0, 0.0 };
+    std::vector<std::string> growth;
+    int registered = 0;
+    for (int step = 1; step <= GROWTH_STEPS; ++step) {
+        int target = iterations * step / GROWTH_STEPS;
+        OpStats chunk = runParallel(target - registered, threads, registOp);
+        regist.latenciesMs.insert(regist.latenciesMs.end(), chunk.latenciesMs.begin(), chunk.latenciesMs.end());
+        regist.errors += chunk.errors;
+        regist.wallMs += chunk.wallMs;
+        registered = target;
+        OpStats sample = runParallel(GROWTH_PREDICTIONS, 1, predictOp);
+        growth.push_back("{\"registered\": " + std::to_string(registered) +
+                         ", \"predict_p50_ms\": " + std::to_string(percentile(sample.latenciesMs, 50)) +
+                         ", \"predict_p95_ms\": " + std::to_string(percentile(sample.latenciesMs, 95)) +
+                         ", \"rss_kb\": " + std::to_string(memoryUsage().rssKb) + "}");
+    }
+
+    OpStats predict = runParallel(iterations, threads, predictOp);
+    std::vector<std::string> inputSizes = measureInputSizes(prep);
+    std::string streamRun = measureStream();
+    std::vector<std::string> threadSweep = sweepThreads(sweep, threadConfig, iterations, threads);
+    predictorConfigureThreads(threadConfig);
+    std::vector<std::string> cascade = sweepCascade(margins, prep);
+    OpStats save = runParallel(slowIterations, 1, saveOp);
+    OpStats remove = runParallel(slowIterations, 1, deleteOp);
+    OpStats reload = runParallel(slowIterations, 1, loadOp);
+    load.latenciesMs.insert(load.latenciesMs.end(), reload.latenciesMs.begin(), reload.latenciesMs.end());
+    load.errors += reload.errors;
+    load.wallMs += reload.wallMs;
+
+    std::string beforeCompact = measureGallery();
+    predictorSetLabelCap(nullptr, compactCap);
+    CompactReport compact;
+    auto compactStart = std::chrono::high_resolution_clock::now();
+    int pruned = predictorCompact(handle, nullptr, &compact);
+    auto compactEnd = std::chrono::high_resolution_clock::now();
+    std::string afterCompact = measureGallery();
+    std::vector<std::string> galleryScale = measureGalleryScale(gallerySizes);
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"threads\": " << threads << "," << std::endl;
+    std::cout << "  \"iterations\": " << iterations << "," << std::endl;
+    std::cout << "  \"slow_iterations\": " << slowIterations << "," << std::endl;
+    std::cout << "  \"corpus_images\": " << corpus.size() << "," << std::endl;
+    std::cout << "  \"ops\": {" << std::endl;
+    printOp("predict", predict, false);
+    printOp("regist", regist, false);
+    printOp("save", save, false);
+    printOp("load", load, false);
+    printOp("delete", remove, true);
+    std::cout << "  }," << std::endl;
+    std::cout << "  \"gallery_growth\": [" << std::endl;
+    for (size_t i = 0; i < growth.size(); ++i) {
+        std::cout << "    " << growth[i] << (i + 1 < growth.size() ? "," : "") << std::endl;
+    }
+    std::cout << "  ]," << std::endl;
+    std::cout << "  \"input_sizes\": {\"prep_min_side\": " << prep.minSide << ", \"roi\": [" << prep.roi.x << ", "
+              << prep.roi.y << ", " << prep.roi.width << ", " << prep.roi.height << "], \"sizes\": [" << std::endl;
+    for (size_t i = 0; i < inputSizes.size(); ++i) {
+        std::cout << "    " << inputSizes[i] << (i + 1 < inputSizes.size() ? "," : "") << std::endl;
+    }
+    std::cout << "  ]}," << std::endl;
+    std::cout << "  \"stream\": " << streamRun << "," << std::endl;
+    std::cout << "  \"cascade\": [" << std::endl;
+    for (size_t i = 0; i < cascade.size(); ++i) {
+        std::cout << "    " << cascade[i] << (i + 1 < cascade.size() ? "," : "") << std::endl;
+    }
+    std::cout << "  ]," << std::endl;
+    std::cout << "  \"thread_sweep\": [" << std::endl;
+    for (size_t i = 0; i < threadSweep.size(); ++i) {
+        std::cout << "    " << threadSweep[i] << (i + 1 < threadSweep.size() ? "," : "") << std::endl;
+    }
+    std::cout << "  ]," << std::endl;
+    std::cout << "  \"compaction\": {\"cap\": " << compactCap << ", \"pruned\": " << pruned
+              << ", \"duplicates\": " << compact.duplicates << ", \"evicted\": " << compact.evicted
+              << ", \"skipped_labels\": " << compact.skippedLabels
+              << ", \"entries_before\": " << compact.entriesBefore << ", \"entries_after\": " << compact.entriesAfter
+              << ", \"ms\": " << std::chrono::duration<double, std::milli>(compactEnd - compactStart).count()
+              << "," << std::endl;
+    std::cout << "    \"before\": " << beforeCompact << "," << std::endl;
+    std::cout << "    \"after\": " << afterCompact << std::endl;
+    std::cout << "  }," << std::endl;
+    std::cout << "  \"gallery_scale\": [" << std::endl;
+    for (size_t i = 0; i < galleryScale.size(); ++i) {
+        std::cout << "    " << galleryScale[i] << (i + 1 < galleryScale.size() ? "," : "") << std::endl;
+    }
+    std::cout << "  ]" << std::endl;
+    std::cout << "}" << std::endl;
+
+    predictorSaveShutdown();
+    predictorDestroy(handle);
+    removeDirectory(scratch_dir);
+    dlclose(lib_handle);
+    return 0;
+}
+
+// Run op(0..count-1) on the given number of threads and collect latencies
+OpStats runParallel(int count, int threads, double (*op)(int index)) {
+    std::atomic<int> next(0);
+    std::vector<std::vector<double> > latencies(threads);
+    std::vector<int> errors(threads, 0);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::thread([&, t] {
+            for (int i = next++; i < count; i = next++) {
+                double ms = op(i);
+                if (ms < 0) {
+                    ++errors[t];
+                } else {
+                    latencies[t].push_back(ms);
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    OpStats stats = { std::vector<double>(), 0, std::chrono::duration<double, std::milli>(end - start).count() };
+    for (int t = 0; t < threads; ++t) {
+        stats.latenciesMs.insert(stats.latenciesMs.end(), latencies[t].begin(), latencies[t].end());
+        stats.errors += errors[t];
+    }
+    return stats;
+}
+
+/**
+ * Save the gallery and measure it: saved model size, resident memory, and
+ * predict latency and top-1 accuracy over the corpus.
+ */
+std::string measureGallery() {
+    predictorSave(handle);
+    long long modelBytes = lockedDirectorySize(scratch_dir);
+    std::vector<double> latencies;
+    int correct = 0;
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        PredictScore scores[MAX_SCORES];
+        int scoreCount = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        int result = predictScores(handle, corpus[i].bytes.data(), static_cast<long>(corpus[i].bytes.size()),
+                                   0.0f, scores, MAX_SCORES, &scoreCount);
+        auto end = std::chrono::high_resolution_clock::now();
+        latencies.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        int best = -1;
+        for (int s = 0; s < scoreCount; ++s) {
+            if (best < 0 || scores[s].score > scores[best].score) {
+                best = s;
+            }
+        }
+        if (result >= 0 && best >= 0 && corpus[i].label == labelName(scores[best].labelId)) {
+            ++correct;
+        }
+    }
+    return "{\"model_kb\": " + std::to_string(modelBytes / 1024) +
+           ", \"rss_kb\": " + std::to_string(memoryUsage().rssKb) +
+           ", \"predict_p50_ms\": " + std::to_string(percentile(latencies, 50)) +
+           ", \"predict_p95_ms\": " + std::to_string(percentile(latencies, 95)) +
+           ", \"top1_accuracy\": " + std::to_string(corpus.empty() ? 0.0 : static_cast<double>(correct) / corpus.size()) + "}";
+}
+
+// Size of the model directory while no save can be rewriting it
+long long lockedDirectorySize(const std::string& dir) {
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    return directorySize(dir);
+}
+
+/**
+ * For each distinct frame size in the corpus, time predict on the original
+ * bytes and on the prepared bytes, and record how far each pushes peak RSS
+ * above the resident size at the start of the run.
+ */
+std::vector<std::string> measureInputSizes(const PrepOptions& options) {
+    std::vector<std::pair<std::string, std::vector<size_t> > > sizes;
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        int width = 0;
+        int height = 0;
+        jpegSize(corpus[i].bytes.data(), static_cast<long>(corpus[i].bytes.size()), &width, &height);
+        std::string key = std::to_string(width) + "x" + std::to_string(height);
+        size_t s = 0;
+        while (s < sizes.size() && sizes[s].first != key) {
+            ++s;
+        }
+        if (s == sizes.size()) {
+            sizes.push_back(std::make_pair(key, std::vector<size_t>()));
+        }
+        sizes[s].second.push_back(i);
+    }
+
+    std::vector<std::string> rows;
+    char buffer[4096];
+    for (size_t s = 0; s < sizes.size(); ++s) {
+        const std::vector<size_t>& members = sizes[s].second;
+        std::vector<double> rawMs;
+        std::vector<double> prepareMs;
+        std::vector<double> preparedMs;
+        PrepInfo info = { 0, 0, 0, 0, 1 };
+        int failures = 0;
+
+        resetPeakMemory();
+        long base = memoryUsage().rssKb;
+        for (int n = 0; n < SIZE_PREDICTIONS; ++n) {
+            CorpusImage& image = corpus[members[n % members.size()]];
+            rawMs.push_back(timeCall([&] {
+                return predictorPredict(handle, image.bytes.data(), static_cast<long>(image.bytes.size()),
+                                        PREDICTION_THRESHOLD, buffer, sizeof(buffer)) >= 0;
+            }));
+        }
+        long rawPeak = memoryUsage().peakKb - base;
+
+        resetPeakMemory();
+        base = memoryUsage().rssKb;
+        for (int n = 0; n < SIZE_PREDICTIONS; ++n) {
+            CorpusImage& image = corpus[members[n % members.size()]];
+            std::vector<unsigned char> prepared;
+            auto start = std::chrono::high_resolution_clock::now();
+            int result = prepareJpeg(image.bytes.data(), static_cast<long>(image.bytes.size()), options, &prepared, &info);
+            auto end = std::chrono::high_resolution_clock::now();
+            if (result < 0) {
+                ++failures;
+                continue;
+            }
+            std::vector<unsigned char>& bytes = result == 0 ? prepared : image.bytes;
+            double prepMs = std::chrono::duration<double, std::milli>(end - start).count();
+            double predictMs = timeCall([&] {
+                return predictorPredict(handle, bytes.data(), static_cast<long>(bytes.size()),
+                                        PREDICTION_THRESHOLD, buffer, sizeof(buffer)) >= 0;
+            });
+            prepareMs.push_back(prepMs);
+            preparedMs.push_back(predictMs < 0 ? predictMs : prepMs + predictMs);
+        }
+        long preparedPeak = memoryUsage().peakKb - base;
+
+        rows.push_back("{\"size\": \"" + sizes[s].first + "\", \"images\": " + std::to_string(members.size()) +
+                       ", \"output\": \"" + std::to_string(info.outWidth) + "x" + std::to_string(info.outHeight) +
+                       "\", \"scale_denom\": " + std::to_string(info.scaleDenom) +
+                       ", \"raw_predict_p50_ms\": " + std::to_string(percentile(rawMs, 50)) +
+                       ", \"raw_peak_delta_kb\": " + std::to_string(rawPeak) +
+                       ", \"prepare_p50_ms\": " + std::to_string(percentile(prepareMs, 50)) +
+                       ", \"prepared_predict_p50_ms\": " + std::to_string(percentile(preparedMs, 50)) +
+                       ", \"prepared_peak_delta_kb\": " + std::to_string(preparedPeak) +
+                       ", \"prepare_failures\": " + std::to_string(failures) + "}");
+    }
+    return rows;
+}
+
+/**
+ * Replay the corpus as a camera feed that holds each image for
+ * STREAM_HOLD_FRAMES frames, once predicting every frame and once through
+ * a stream session, and compare process CPU time per frame.
+ */
+std::string measureStream() {
+    std::vector<size_t> feed;
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        feed.insert(feed.end(), STREAM_HOLD_FRAMES, i);
+    }
+    char buffer[4096];
+    std::clock_t start = std::clock();
+    for (size_t f = 0; f < feed.size(); ++f) {
+        CorpusImage& image = corpus[feed[f]];
+        predictorPredict(handle, image.bytes.data(), static_cast<long>(image.bytes.size()),
+                         PREDICTION_THRESHOLD, buffer, sizeof(buffer));
+    }
+    double everyFrameMs = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC;
+
+    PredictorStream* stream = streamCreate(handle, PREDICTION_THRESHOLD, nullptr, true);
+    start = std::clock();
+    for (size_t f = 0; f < feed.size(); ++f) {
+        CorpusImage& image = corpus[feed[f]];
+        streamFeed(stream, image.bytes.data(), static_cast<long>(image.bytes.size()), buffer, sizeof(buffer), nullptr);
+    }
+    double streamMs = 1000.0 * (std::clock() - start) / CLOCKS_PER_SEC;
+    StreamStats stats = stream->stats;
+    streamDestroy(stream);
+
+    double frames = feed.empty() ? 1.0 : static_cast<double>(feed.size());
+    return "{\"frames\": " + std::to_string(feed.size()) +
+           ", \"hold_frames\": " + std::to_string(STREAM_HOLD_FRAMES) +
+           ", \"predictions\": " + std::to_string(stats.predictions) +
+           ", \"cached\": " + std::to_string(stats.cached) +
+           ", \"settling\": " + std::to_string(stats.settling) +
+           ", \"every_frame_cpu_ms_per_frame\": " + std::to_string(everyFrameMs / frames) +
+           ", \"stream_cpu_ms_per_frame\": " + std::to_string(streamMs / frames) +
+           ", \"cpu_reduction\": " + std::to_string(streamMs > 0 ? everyFrameMs / streamMs : 0.0) + "}";
+}
+
+/**
+ * Predict over the corpus at each inference thread count, with the same
+ * caller threads, and report latency, throughput and CPU time per call.
+ */
+std::vector<std::string> sweepThreads(const std::vector<int>& counts, ThreadConfig config, int iterations, int threads) {
+    std::vector<std::string> rows;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        config.threads = counts[i];
+        bool applied = predictorConfigureThreads(config);
+        runParallel(SWEEP_WARMUP, 1, predictOp);
+        std::clock_t cpuStart = std::clock();
+        OpStats stats = runParallel(iterations, threads, predictOp);
+        double cpuMs = 1000.0 * (std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        size_t count = stats.latenciesMs.size();
+        rows.push_back("{\"sdk_threads\": " + std::to_string(counts[i]) +
+                       ", \"applied\": " + (applied ? "true" : "false") +
+                       ", \"errors\": " + std::to_string(stats.errors) +
+                       ", \"p50_ms\": " + std::to_string(percentile(stats.latenciesMs, 50)) +
+                       ", \"p95_ms\": " + std::to_string(percentile(stats.latenciesMs, 95)) +
+                       ", \"throughput_per_s\": " + std::to_string(stats.wallMs > 0 ? count * 1000.0 / stats.wallMs : 0.0) +
+                       ", \"cpu_ms_per_predict\": " + std::to_string(count ? cpuMs / count : 0.0) + "}");
+    }
+    return rows;
+}
+
+/**
+ * Predict the corpus at full resolution once as the baseline, then through
+ * the cascade at each margin, and report how often the first stage
+ * answered, the latency, and top-1 agreement with the baseline.
+ */
+std::vector<std::string> sweepCascade(const std::vector<float>& margins, const PrepOptions& prep) {
+    std::vector<int> baseline;
+    std::vector<double> baselineMs;
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        PredictScore scores[MAX_SCORES];
+        int scoreCount = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        int result = predictScores(handle, corpus[i].bytes.data(), static_cast<long>(corpus[i].bytes.size()),
+                                   PREDICTION_THRESHOLD, scores, MAX_SCORES, &scoreCount);
+        auto end = std::chrono::high_resolution_clock::now();
+        baselineMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        baseline.push_back(result >= 0 ? topLabel(scores, scoreCount) : -1);
+    }
+
+    std::vector<std::string> rows;
+    rows.push_back("{\"margin\": null, \"first_stage_share\": 0, \"p50_ms\": " +
+                   std::to_string(percentile(baselineMs, 50)) + ", \"p95_ms\": " +
+                   std::to_string(percentile(baselineMs, 95)) + ", \"top1_agreement\": 1}");
+    for (size_t m = 0; m < margins.size(); ++m) {
+        CascadeOptions options = { margins[m], CASCADE_FIRST_SIDE, prep.roi };
+        std::vector<double> latencies;
+        int first = 0;
+        int agreed = 0;
+        for (size_t i = 0; i < corpus.size(); ++i) {
+            PredictScore scores[MAX_SCORES];
+            int scoreCount = 0;
+            CascadeReport report;
+            int result = predictCascade(handle, corpus[i].bytes.data(), static_cast<long>(corpus[i].bytes.size()),
+                                        PREDICTION_THRESHOLD, options, scores, MAX_SCORES, &scoreCount, &report);
+            latencies.push_back(report.firstMs + report.fullMs);
+            first += report.stage == CASCADE_FIRST ? 1 : 0;
+            agreed += (result >= 0 ? topLabel(scores, scoreCount) : -1) == baseline[i] ? 1 : 0;
+        }
+        double count = corpus.empty() ? 1.0 : static_cast<double>(corpus.size());
+        rows.push_back("{\"margin\": " + std::to_string(margins[m]) +
+                       ", \"first_stage_share\": " + std::to_string(first / count) +
+                       ", \"p50_ms\": " + std::to_string(percentile(latencies, 50)) +
+                       ", \"p95_ms\": " + std::to_string(percentile(latencies, 95)) +
+                       ", \"top1_agreement\": " + std::to_string(agreed / count) + "}");
+    }
+    return rows;
+}
+
+/**
+ * Fill the scratch gallery to each of sizes, in ascending order, and measure
+ * predict latency, resident memory and saved model size at each. Corpus
+ * images are registered under SCALE_LABELS synthetic labels straight through
+ * the SDK: the scratch copy is discarded afterwards, so neither the journal
+ * nor the entry store needs them.
+ */
+std::vector<std::string> measureGalleryScale(const std::vector<int>& sizes) {
+    std::vector<std::string> rows;
+    if (sizes.empty()) {
+        return rows;
+    }
+    predictorSave(handle);
+    long long baseBytes = lockedDirectorySize(scratch_dir);
+    int registered = 0;
+    std::vector<int> targets(sizes);
+    std::sort(targets.begin(), targets.end());
+    for (size_t step = 0; step < targets.size(); ++step) {
+        for (; registered < targets[step]; ++registered) {
+            CorpusImage& image = corpus[registered % corpus.size()];
+            std::string label = "__scale_" + std::to_string(registered % SCALE_LABELS);
+            std::lock_guard<std::mutex> lock(sdk_mutex);
+            if (regist_func(image.bytes.data(), static_cast<long>(image.bytes.size()), label.c_str(), 6) < 0) {
+                break;
+            }
+        }
+        if (registered < targets[step]) {
+            std::cerr << "Registration failed after " << registered << " entries" << std::endl;
+            break;
+        }
+        OpStats sample = runParallel(GROWTH_PREDICTIONS, 1, predictOp);
+        predictorSave(handle);
+        long long savedBytes = lockedDirectorySize(scratch_dir);
+        rows.push_back("{\"entries\": " + std::to_string(registered) +
+                       ", \"predict_p50_ms\": " + std::to_string(percentile(sample.latenciesMs, 50)) +
+                       ", \"predict_p95_ms\": " + std::to_string(percentile(sample.latenciesMs, 95)) +
+                       ", \"rss_kb\": " + std::to_string(memoryUsage().rssKb) +
+                       ", \"saved_kb\": " + std::to_string(savedBytes / 1024) +
+                       ", \"saved_bytes_per_entry\": " +
+                       std::to_string(registered > 0 ? (savedBytes - baseBytes) / registered : 0) + "}");
+    }
+    return rows;
+}
+
+// Label id of the best score, or -1 without candidates
+int topLabel(const PredictScore* scores, int scoreCount) {
+    int best = -1;
+    for (int s = 0; s < scoreCount; ++s) {
+        if (best < 0 || scores[s].score > scores[best].score) {
+            best = s;
+        }
+    }
+    return best < 0 ? -1 : scores[best].labelId;
+}
+
+void printOp(const char* name, const OpStats& stats, bool last) {
+    double mean = 0.0;
+    for (size_t i = 0; i < stats.latenciesMs.size(); ++i) {
+        mean += stats.latenciesMs[i];
+    }
+    mean = stats.latenciesMs.empty() ? 0.0 : mean / stats.latenciesMs.size();
+    std::cout << "    \"" << name << "\": {\"count\": " << stats.latenciesMs.size()
+              << ", \"errors\": " << stats.errors
+              << ", \"mean_ms\": " << mean
+              << ", \"p50_ms\": " << percentile(stats.latenciesMs, 50)
+              << ", \"p95_ms\": " << percentile(stats.latenciesMs, 95)
+              << ", \"p99_ms\": " << percentile(stats.latenciesMs, 99)
+              << ", \"throughput_per_s\": " << (stats.wallMs > 0 ? stats.latenciesMs.size() * 1000.0 / stats.wallMs : 0.0)
+              << "}" << (last ? "" : ",") << std::endl;
+}
+
+// Read dir/<label>/<image> for every label sub-directory, in name order
+std::vector<CorpusImage> readCorpus(const std::string& dir) {
+    std::vector<std::pair<std::string, std::string> > files;
+    if (!listLabelFiles(dir, &files)) {
+        throw std::runtime_error("Failed to open image directory: " + dir);
+    }
+    std::vector<CorpusImage> images(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        images[i].label = files[i].second;
+        images[i].bytes = readImage(files[i].first);
+    }
+    return images;
+}
+
+// Parse a comma-separated list of positive counts such as "1,2,4"; ranges are not accepted
+bool parseCountList(const char* text, std::vector<int>* counts) {
+    counts->clear();
+    for (const char* cursor = text; *cursor;) {
+        char* end = nullptr;
+        long value = std::strtol(cursor, &end, 10);
+        if (end == cursor || value <= 0 || value > INT_MAX || (*end && *end != ',')) {
+            return false;
+        }
+        counts->push_back(static_cast<int>(value));
+        cursor = *end ? end + 1 : end;
+    }
+    return !counts->empty();
+}
@@ -1,6 +1,10 @@
 /**
  * @file demo_linux.cpp
  * @brief Image processing and prediction demonstration program (Linux version)
+ * @note Build: g++ -std=c++11 demo.cpp smart_predictor.cpp predictor_daemon.cpp predictor_ipc.cpp -o demo -ldl -pthread
+ * @note Run "./demo --daemon [socket]" to serve the model to other processes through libsmart_predictor_client.so
+ * @note SMART_PREDICTOR_THREADS, SMART_PREDICTOR_CPUS and SMART_PREDICTOR_SPIN configure the inference threads
+ * @note SMART_PREDICTOR_MODEL_TYPE loads another model variant; compare variants with ./evaluate first
  */
 
 #include <iostream>
@@ -8,48 +12,50 @@
 #include <vector>
 #include <chrono>
 #include <stdexcept>
-#include <fstream>
 #include <dlfcn.h>
 #include <unistd.h>
 #include <termios.h>
 #include <limits.h>
+#include <cstdlib>
+#include <thread>
+#include <poll.h>
+#include <map>
+#include <sstream>
+
+#include "smart_predictor.h"
+#include "predictor_ipc.h"
 
 // Configuration parameters
-const char* LIB_NAME = "./lib/libsmart_predictor_jni.so";
 const char* MODEL_DIR = "./model";
 const char* TEST_IMAGE_PATH = "demo.jpg";
 float PREDICTION_THRESHOLD = 0.3f;
+const int MODEL_TYPE = modelTypeFromEnv();  // model_type of SmartPredictor_load, see modelTypeFromEnv()
+const int BATCH_SIZE = 8;  // Frames per weigh event used by the batch demo
+const int INPUT_TIMING_ROUNDS = 20;  // Predictions per input path in the timing demo
+const int LABEL_CAP = 50;  // Entries kept per label when the gallery is compacted
+const int WARMUP_ROUNDS = 3;  // Throw-away predictions run right after loading the model
+const int LANE_COUNT = 3;  // Concurrent checkout lanes in the multi-lane demo
+const int LANE_PREDICTIONS = 10;  // Predictions per lane in the multi-lane demo
 
-// Function pointers
-void* lib_handle = nullptr;
-using SmartPredictor_load = int(*)(const char*, int);
-using SmartPredictor_unload = int(*)();
-using SmartPredictor_predict_img = int(*)(unsigned char*, long, float, char*, long);
-using SmartPredictor_regist_img = int(*)(unsigned char*, long, const char*, int);
-using SmartPredictor_save = int(*)(const char*);
-using SmartPredictor_reset = bool(*)(const char*);
-using SmartPredictor_delete = bool(*)(const char*);
-using SmartPredictor_sign = int(*)(const char*, const char*);
-
-SmartPredictor_load load_func = nullptr;
-SmartPredictor_unload unload_func = nullptr;
-SmartPredictor_predict_img predict_func = nullptr;
-SmartPredictor_regist_img regist_func = nullptr;
-SmartPredictor_save save_func = nullptr;
-SmartPredictor_reset reset_func = nullptr;
-SmartPredictor_delete delete_func = nullptr;
-SmartPredictor_sign sign_func = nullptr;
+SmartPredictor* predictor = nullptr;  // Handle used by the interactive menu
 
 // Function declarations
-std::vector<unsigned char> readImage(const std::string& filePath);
+std::vector<unsigned char>& testImage();
 void displayMenu();
-bool loadLibrary();
-bool getFunctionPointers();
+void runLane(int lane, double* avgMs);
 int getch();
 
-int main() {
-    std::cout << "Welcome to Ronsson AI SDK (Linux Version)" << std::endl;
+int main(int argc, char* argv[]) {
+    bool daemonMode = argc > 1 && std::string(argv[1]) == "--daemon";
+    if (!daemonMode) {
+        std::cout << "Welcome to Ronsson AI SDK (Linux Version)" << std::endl;
+    }
     
+    ThreadConfig threadConfig;
+    if (threadConfigFromEnv(&threadConfig)) {
+        predictorConfigureThreads(threadConfig);
+    }
+
     if (!loadLibrary()) {
         std::cerr << "Failed to load library: " << dlerror() << std::endl;
         std::cout << "Press any key to exit..." << std::endl;
@@ -63,9 +69,17 @@ int main() {
         getch();
         return -1;
     }
+
+    if (daemonMode) {
+        const char* socketPath = argc > 2 ? argv[2] : DAEMON_SOCKET_PATH;
+        int result = runDaemon(socketPath, MODEL_DIR, MODEL_TYPE);
+        dlclose(lib_handle);
+        return result;
+    }
     
     bool running = true;
     int choice;
+    long lastToken = 0;  // Token of the last 'p' prediction
     
     while (running) {
         displayMenu();
@@ -92,43 +106,169 @@ int main() {
             case 'l': {
                 // Load Model
                 std::cout << "Loading model..." << std::endl;
-                if (load_func(MODEL_DIR, 4) < 0) {
+                predictorDestroy(predictor);
+                predictor = nullptr;
+                MemoryUsage before = memoryUsage();
+                auto start = std::chrono::high_resolution_clock::now();
+                predictor = predictorCreate(MODEL_DIR, MODEL_TYPE);
+                auto end = std::chrono::high_resolution_clock::now();
+                MemoryUsage after = memoryUsage();
+                if (!predictor) {
                     std::cout << "Failed to load model" << std::endl;
                 } else {
+                    predictorSetAutosave(AUTOSAVE_INTERVAL_SECONDS, AUTOSAVE_REGISTS);
+                    predictorSetLabelCap(nullptr, LABEL_CAP);
                     std::cout << "Model loaded successfully" << std::endl;
+                    if (journal_replayed > 0) {
+                        std::cout << "Replayed " << journal_replayed << " journaled registrations" << std::endl;
+                    }
+                }
+                std::cout << "Load time: " << std::chrono::duration<double, std::milli>(end - start).count()
+                          << "ms" << std::endl;
+                if (predictor) {
+                    try {
+                        std::vector<unsigned char>& imageData = testImage();
+                        auto warmStart = std::chrono::high_resolution_clock::now();
+                        int warmed = predictorWarmup(predictor, imageData.data(), static_cast<long>(imageData.size()),
+                                                     WARMUP_ROUNDS);
+                        auto warmEnd = std::chrono::high_resolution_clock::now();
+                        std::cout << "Warm-up: " << warmed << "/" << WARMUP_ROUNDS << " predictions in "
+                                  << std::chrono::duration<double, std::milli>(warmEnd - warmStart).count()
+                                  << "ms" << std::endl;
+                    } catch (const std::exception& e) {
+                        std::cerr << "Warm-up skipped: " << e.what() << std::endl;
+                    }
                 }
+                std::cout << "RSS: " << before.rssKb << "kB -> " << after.rssKb << "kB (private "
+                          << before.anonKb << "kB -> " << after.anonKb << "kB, file-backed "
+                          << before.fileKb << "kB -> " << after.fileKb << "kB)" << std::endl;
                 break;
             }
             case 'p': {
                 // Predict
                 std::cout << "Processing image for prediction..." << std::endl;
                 try {
-                    std::vector<unsigned char> imageData = readImage(TEST_IMAGE_PATH);
+                    std::vector<unsigned char>& imageData = testImage();
                     char buffer[1024];
-                    int predictResult = predict_func(imageData.data(),
+                    int predictResult = predictWithToken(predictor, imageData.data(),
                         static_cast<unsigned int>(imageData.size()), 
                         PREDICTION_THRESHOLD,
                         buffer,
-                        sizeof(buffer));
+                        sizeof(buffer),
+                        &lastToken);
                     std::cout << "Prediction result: " << predictResult << std::endl;
                     std::cout << "Prediction content: " << buffer << std::endl;
+
+                    PredictScore scores[MAX_SCORES];
+                    int scoreCount = 0;
+                    int totalScores = predictResult >= 0 ? parseScores(buffer, scores, MAX_SCORES, &scoreCount) : -1;
+                    for (int i = 0; i < scoreCount; ++i) {
+                        std::cout << "  " << (i + 1) << ". " << labelName(scores[i].labelId)
+                                  << " (id " << scores[i].labelId << "): " << scores[i].score << std::endl;
+                    }
+                    if (totalScores > scoreCount) {
+                        std::cout << "  (" << totalScores - scoreCount << " weaker candidates not shown)" << std::endl;
+                    }
                 } catch (const std::exception& e) {
                     std::cout << "Failed to predict image: " << e.what() << std::endl;
                 }
                 break;
             }
+            case 'k': {
+                // Register Last Prediction
+                if (lastToken == 0) {
+                    std::cout << "Predict an image first" << std::endl;
+                    break;
+                }
+                std::cout << "Enter label for the last prediction: ";
+                std::string label;
+                std::getline(std::cin, label);
+                std::cout << "Enter selected position (1-6): ";
+                std::string pos;
+                std::getline(std::cin, pos);
+                int registResult = registByToken(predictor, lastToken, label.c_str(), std::atoi(pos.c_str()));
+                lastToken = 0;
+                std::cout << "Registration result: " << registResult << std::endl;
+                break;
+            }
+            case 'b': {
+                // Batch Predict
+                std::cout << "Predicting a burst of " << BATCH_SIZE << " frames..." << std::endl;
+                try {
+                    std::vector<unsigned char>& imageData = testImage();
+                    std::vector<unsigned char*> images(BATCH_SIZE, imageData.data());
+                    std::vector<long> sizes(BATCH_SIZE, static_cast<long>(imageData.size()));
+                    std::vector<char> storage(BATCH_SIZE * 1024);
+                    std::vector<char*> results(BATCH_SIZE);
+                    std::vector<int> codes(BATCH_SIZE);
+                    for (int i = 0; i < BATCH_SIZE; ++i) {
+                        results[i] = &storage[i * 1024];
+                    }
+
+                    auto start = std::chrono::high_resolution_clock::now();
+                    int succeeded = predictBatch(predictor, images.data(), sizes.data(), BATCH_SIZE, PREDICTION_THRESHOLD,
+                                                 results.data(), 1024, codes.data());
+                    auto end = std::chrono::high_resolution_clock::now();
+
+                    // The SDK has no batch entry point yet, so this is the per-frame baseline
+                    double batchMs = std::chrono::duration<double, std::milli>(end - start).count();
+                    std::cout << "Burst baseline (one SDK call per frame): " << batchMs << "ms ("
+                              << BATCH_SIZE * 1000.0 / batchMs << " frames/s)" << std::endl;
+                    std::cout << "Batch result: " << succeeded << "/" << BATCH_SIZE << " succeeded" << std::endl;
+                    std::cout << "First frame content: " << results[0] << std::endl;
+                } catch (const std::exception& e) {
+                    std::cout << "Failed to predict batch: " << e.what() << std::endl;
+                }
+                break;
+            }
+            case 't': {
+                // Time input paths
+                std::cout << "Timing " << INPUT_TIMING_ROUNDS << " predictions per input path..." << std::endl;
+                try {
+                    char buffer[1024];
+                    double readMs = 0.0;
+                    double fileMs = 0.0;
+                    for (int i = 0; i < INPUT_TIMING_ROUNDS; ++i) {
+                        auto start = std::chrono::high_resolution_clock::now();
+                        std::vector<unsigned char> imageData = readImage(TEST_IMAGE_PATH);
+                        auto mid = std::chrono::high_resolution_clock::now();
+                        predictorPredict(predictor, imageData.data(), static_cast<long>(imageData.size()),
+                                         PREDICTION_THRESHOLD, buffer, sizeof(buffer));
+                        auto end = std::chrono::high_resolution_clock::now();
+                        readMs += std::chrono::duration<double, std::milli>(mid - start).count();
+                        fileMs += std::chrono::duration<double, std::milli>(end - start).count();
+                    }
+
+                    std::vector<unsigned char>& imageData = testImage();
+                    auto start = std::chrono::high_resolution_clock::now();
+                    for (int i = 0; i < INPUT_TIMING_ROUNDS; ++i) {
+                        predictorPredict(predictor, imageData.data(), static_cast<long>(imageData.size()),
+                                         PREDICTION_THRESHOLD, buffer, sizeof(buffer));
+                    }
+                    auto end = std::chrono::high_resolution_clock::now();
+                    double memoryMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+                    std::cout << "Read file + predict: " << fileMs / INPUT_TIMING_ROUNDS << "ms/frame (file read "
+                              << readMs / INPUT_TIMING_ROUNDS << "ms)" << std::endl;
+                    std::cout << "In-memory JPEG predict: " << memoryMs / INPUT_TIMING_ROUNDS << "ms/frame" << std::endl;
+                    std::cout << "JPEG size: " << imageData.size() << " bytes" << std::endl;
+                } catch (const std::exception& e) {
+                    std::cout << "Failed to time prediction: " << e.what() << std::endl;
+                }
+                break;
+            }
             case 'r': {
                 // Register Image
                 std::cout << "Enter label for the image: ";
                 std::string label;
                 std::getline(std::cin, label); 
                 try {
-                    std::vector<unsigned char> imageData = readImage(TEST_IMAGE_PATH);
+                    std::vector<unsigned char>& imageData = testImage();
                     auto start = std::chrono::high_resolution_clock::now();
                     
-                    int registResult = regist_func(imageData.data(), 
-                                                  static_cast<unsigned int>(imageData.size()), 
-                                                  label.c_str(), 6);
+                    int registResult = predictorRegist(predictor, imageData.data(),
+                                                       static_cast<unsigned int>(imageData.size()),
+                                                       label.c_str(), 6);
                     
                     auto end = std::chrono::high_resolution_clock::now();
                     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
@@ -143,17 +283,37 @@ int main() {
             case 's': {
                 // Save Model
                 std::cout << "Saving model..." << std::endl;
-                if (save_func(MODEL_DIR) != 1) {
+                if (predictorSave(predictor) != 1) {
                     std::cout << "Failed to save model" << std::endl;
                 } else {
                     std::cout << "Model saved successfully" << std::endl;
                 }
                 break;
             }
+            case 'v': {
+                // Background Save
+                SaveStatus status = predictorSaveStatus();
+                std::cout << "Unsaved registrations: " << status.pendingRegists << std::endl;
+                std::cout << "Saving model in the background..." << std::endl;
+                long target = status.completed + 1;
+                predictorSaveAsync(predictor);
+                auto start = std::chrono::high_resolution_clock::now();
+                while ((status = predictorSaveStatus()).completed < target && predictor) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+                auto end = std::chrono::high_resolution_clock::now();
+                if (!predictor || status.lastResult != 1) {
+                    std::cout << "Failed to save model" << std::endl;
+                } else {
+                    std::cout << "Model saved in the background in "
+                              << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
+                }
+                break;
+            }
             case 'c': {
                 // Clear Model
                 std::cout << "Clearing model..." << std::endl;
-                if (reset_func(MODEL_DIR)) {
+                if (predictorReset(MODEL_DIR)) {
                     std::cout << "Model cleared successfully" << std::endl;
                 } else {
                     std::cout << "Failed to clear model" << std::endl;
@@ -167,23 +327,221 @@ int main() {
                 std::getline(std::cin, label_to_delete);
                 
                 std::cout << "Deleting label '" << label_to_delete << "'..." << std::endl;
-                if (delete_func(label_to_delete.c_str())) {
+                if (predictorDelete(predictor, label_to_delete.c_str())) {
                     std::cout << "Label deleted successfully" << std::endl;
                 } else {
                     std::cout << "Failed to delete label" << std::endl;
                 }
                 break;
             }
+            case 'g': {
+                // Enable Entry Store
+                std::cout << "The entry store keeps a copy of every registered image in " << MODEL_DIR
+                          << " until compaction drops it. Enable it? (y/N): ";
+                std::string answer;
+                std::getline(std::cin, answer);
+                if (answer != "y" && answer != "Y") {
+                    std::cout << "Entry store left off" << std::endl;
+                } else if (predictorEnableEntryStore(MODEL_DIR)) {
+                    std::cout << "Entry store enabled" << std::endl;
+                } else {
+                    std::cout << "Failed to enable the entry store" << std::endl;
+                }
+                break;
+            }
+            case 'o': {
+                // Compact Gallery
+                std::cout << "Enter label to compact (empty for all): ";
+                std::string label_to_compact;
+                std::getline(std::cin, label_to_compact);
+                CompactReport report;
+                auto start = std::chrono::high_resolution_clock::now();
+                int pruned = predictorCompact(predictor, label_to_compact.empty() ? nullptr : label_to_compact.c_str(),
+                                              &report);
+                auto end = std::chrono::high_resolution_clock::now();
+                if (pruned < 0) {
+                    std::cout << "Failed to compact gallery (is the entry store enabled? see 'g')" << std::endl;
+                } else {
+                    std::cout << "Pruned " << pruned << " entries (" << report.duplicates << " near-duplicates, "
+                              << report.evicted << " over cap): " << report.entriesBefore << " -> "
+                              << report.entriesAfter << " in "
+                              << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
+                    if (report.skippedLabels > 0) {
+                        std::cout << "Skipped " << report.skippedLabels
+                                  << " labels with entries from before the entry store; delete or reset them to compact"
+                                  << std::endl;
+                    }
+                    std::cout << "Save result: " << report.saveResult << std::endl;
+                }
+                break;
+            }
+            case 'e': {
+                // Export Gallery
+                std::cout << "Enter export file: ";
+                std::string exportPath;
+                std::getline(std::cin, exportPath);
+                std::cout << "Export entries registered since (ms since epoch, empty for all): ";
+                std::string since;
+                std::getline(std::cin, since);
+                long exported = predictorExportGallery(predictor, exportPath.c_str(), std::atoll(since.c_str()));
+                if (exported < 0) {
+                    std::cout << "Failed to export gallery" << std::endl;
+                } else {
+                    std::cout << "Exported " << exported << " entries to " << exportPath << std::endl;
+                }
+                break;
+            }
+            case 'n': {
+                // Merge Gallery
+                std::cout << "Enter export file to merge: ";
+                std::string mergePath;
+                std::getline(std::cin, mergePath);
+                std::cout << "Label mapping as from=to,from=to (to empty drops the label; empty for none): ";
+                std::string mapping;
+                std::getline(std::cin, mapping);
+                std::map<std::string, std::string> labelMap;
+                std::stringstream pairs(mapping);
+                std::string pair;
+                while (std::getline(pairs, pair, ',')) {
+                    size_t equals = pair.find('=');
+                    if (equals != std::string::npos) {
+                        labelMap[pair.substr(0, equals)] = pair.substr(equals + 1);
+                    }
+                }
+                MergeReport report;
+                int merged = predictorMergeGallery(predictor, mergePath.c_str(), labelMap, &report);
+                if (merged < 0) {
+                    std::cout << "Failed to merge " << mergePath
+                              << " (not an export, or the entry store is off; see 'g')" << std::endl;
+                } else {
+                    std::cout << "Merged " << report.imported << " of " << report.records << " entries ("
+                              << report.duplicates << " duplicates, " << report.unmapped << " unmapped, "
+                              << report.failed << " failed) in " << report.seconds * 1000.0 << "ms" << std::endl;
+                    std::cout << "Save result: " << report.saveResult << std::endl;
+                }
+                break;
+            }
+            case 'j': {
+                // List Labels
+                std::vector<LabelCount> labels;
+                predictorListLabels(&labels);
+                std::cout << "Label | Samples" << std::endl;
+                for (size_t i = 0; i < labels.size(); ++i) {
+                    std::cout << labels[i].label << " | " << labels[i].samples << std::endl;
+                }
+                std::cout << labels.size() << " labels" << std::endl;
+                std::cout << "Only entries tracked by the entry store are listed; entries the gallery held"
+                          << " before it was enabled are not" << std::endl;
+                break;
+            }
+            case 'y': {
+                // Rename Label
+                std::cout << "Enter label to rename: ";
+                std::string from;
+                std::getline(std::cin, from);
+                std::cout << "Enter new label (an existing label merges): ";
+                std::string to;
+                std::getline(std::cin, to);
+                int moved = predictorRenameLabel(predictor, from.c_str(), to.c_str());
+                if (moved < 0) {
+                    std::cout << "Label not renamed: it may hold entries from before the entry store"
+                              << " (delete or reset it first), its images could not be read, or some entries"
+                              << " could not be moved and were left under '" << from << "'" << std::endl;
+                } else {
+                    std::cout << "Moved " << moved << " entries from '" << from << "' to '" << to << "'" << std::endl;
+                }
+                break;
+            }
             case 'u': {
                 // Unload Model
                 std::cout << "Unloading model..." << std::endl;
-                if (unload_func() == 0) {
+                if (predictor) {
+                    predictorDestroy(predictor);
+                    predictor = nullptr;
                     std::cout << "Model unloaded successfully" << std::endl;
                 } else {
                     std::cout << "Failed to unload model" << std::endl;
                 }
                 break;
             }
+            case 'm': {
+                // Multi-lane Predict
+                std::cout << "Predicting on " << LANE_COUNT << " lanes concurrently..." << std::endl;
+                std::vector<double> avgMs(LANE_COUNT);
+                std::vector<std::thread> lanes;
+                auto start = std::chrono::high_resolution_clock::now();
+                for (int i = 0; i < LANE_COUNT; ++i) {
+                    lanes.push_back(std::thread(runLane, i, &avgMs[i]));
+                }
+                for (size_t i = 0; i < lanes.size(); ++i) {
+                    lanes[i].join();
+                }
+                auto end = std::chrono::high_resolution_clock::now();
+                double totalMs = std::chrono::duration<double, std::milli>(end - start).count();
+                for (int i = 0; i < LANE_COUNT; ++i) {
+                    if (avgMs[i] < 0) {
+                        std::cout << "Lane " << i << ": failed" << std::endl;
+                    } else {
+                        std::cout << "Lane " << i << ": " << avgMs[i] << "ms/prediction" << std::endl;
+                    }
+                }
+                std::cout << "Throughput: " << LANE_COUNT * LANE_PREDICTIONS * 1000.0 / totalMs
+                          << " predictions/s" << std::endl;
+                break;
+            }
+            case 'i': {
+                // Statistics
+                char stats[8192];
+                if (predictorGetStatsJson(stats, sizeof(stats)) >= static_cast<int>(sizeof(stats))) {
+                    std::cout << "(truncated)" << std::endl;
+                }
+                std::cout << stats << std::endl;
+                break;
+            }
+            case 'x': {
+                // Reset Statistics
+                predictorResetStats();
+                std::cout << "Statistics reset" << std::endl;
+                break;
+            }
+            case 'w': {
+                // Async Predict
+                std::cout << "Submitting async predictions (3 on lane 0, 1 on lane 1)..." << std::endl;
+                try {
+                    std::vector<unsigned char>& imageData = testImage();
+                    long size = static_cast<long>(imageData.size());
+                    auto start = std::chrono::high_resolution_clock::now();
+                    int submitted = 0;
+                    for (int i = 0; i < 3; ++i) {
+                        submitted += predictAsync(predictor, 0, imageData.data(), size,
+                                                  PREDICTION_THRESHOLD, nullptr, nullptr) > 0;
+                    }
+                    submitted += predictAsync(predictor, 1, imageData.data(), size,
+                                              PREDICTION_THRESHOLD, nullptr, nullptr) > 0;
+                    auto end = std::chrono::high_resolution_clock::now();
+                    std::cout << "Submitted " << submitted << " requests in "
+                              << std::chrono::duration<double, std::micro>(end - start).count() << "us" << std::endl;
+
+                    struct pollfd pfd = { predictAsyncFd(), POLLIN, 0 };
+                    PredictCompletion completion;
+                    while (submitted > 0 && poll(&pfd, 1, 5000) > 0) {
+                        while (predictAsyncPoll(&completion)) {
+                            --submitted;
+                            std::cout << "Request " << completion.requestId << " (lane " << completion.lane << "): ";
+                            if (completion.result == PREDICT_CANCELLED) {
+                                std::cout << "cancelled by a newer request" << std::endl;
+                            } else if (completion.result == PREDICT_TRUNCATED) {
+                                std::cout << "result larger than " << MAX_RESULT_BYTES << " bytes" << std::endl;
+                            } else {
+                                std::cout << completion.result << " " << completion.json << std::endl;
+                            }
+                        }
+                    }
+                } catch (const std::exception& e) {
+                    std::cout << "Failed to predict image: " << e.what() << std::endl;
+                }
+                break;
+            }
             case 'q': {
                 // Quit
                 running = false;
@@ -201,6 +559,9 @@ int main() {
         }
     }
     
+    predictAsyncShutdown();
+    predictorSaveShutdown();
+    predictorDestroy(predictor);
     dlclose(lib_handle);
     return 0;
 }
@@ -211,53 +572,59 @@ void displayMenu() {
     std::cout << "Press 'a': SDK Authorization" << std::endl;
     std::cout << "Press 'l': Load Model" << std::endl;
     std::cout << "Press 'p': Predict Image (demo.jpg)" << std::endl;
+    std::cout << "Press 'k': Register Last Prediction (by token)" << std::endl;
+    std::cout << "Press 'b': Batch Predict (demo.jpg x " << BATCH_SIZE << ")" << std::endl;
+    std::cout << "Press 't': Time Prediction Input Paths (demo.jpg)" << std::endl;
     std::cout << "Press 'r': Register Image (demo.jpg)" << std::endl;
     std::cout << "Press 's': Save Model" << std::endl;
+    std::cout << "Press 'v': Save Model in Background" << std::endl;
     std::cout << "Press 'c': Clear Model" << std::endl;
     std::cout << "Press 'd': Delete label from model" << std::endl;
+    std::cout << "Press 'g': Enable Entry Store (needed by compact, rename, export and merge)" << std::endl;
+    std::cout << "Press 'o': Compact Gallery (cap " << LABEL_CAP << " per label, collapse near-duplicates)" << std::endl;
+    std::cout << "Press 'j': List Labels with sample counts" << std::endl;
+    std::cout << "Press 'y': Rename or Merge Label" << std::endl;
+    std::cout << "Press 'e': Export Gallery" << std::endl;
+    std::cout << "Press 'n': Merge Exported Gallery" << std::endl;
     std::cout << "Press 'u': Unload Model" << std::endl;
+    std::cout << "Press 'm': Multi-lane Predict (" << LANE_COUNT << " handles)" << std::endl;
+    std::cout << "Press 'w': Async Predict with lane cancellation" << std::endl;
+    std::cout << "Press 'i': Show Statistics" << std::endl;
+    std::cout << "Press 'x': Reset Statistics" << std::endl;
     std::cout << "Press 'q': Quit" << std::endl;
     std::cout << "====================================" << std::endl;
     std::cout << "Enter your choice: ";
 }
-
-bool loadLibrary() {
-    lib_handle = dlopen(LIB_NAME, RTLD_LAZY);
-    return lib_handle != nullptr;
-}
-
-bool getFunctionPointers() {
-    load_func = (SmartPredictor_load)dlsym(lib_handle, "SmartPredictor_load");
-    unload_func = (SmartPredictor_unload)dlsym(lib_handle, "SmartPredictor_unload");
-    predict_func = (SmartPredictor_predict_img)dlsym(lib_handle, "SmartPredictor_predict_img");
-    regist_func = (SmartPredictor_regist_img)dlsym(lib_handle, "SmartPredictor_regist_img");
-    save_func = (SmartPredictor_save)dlsym(lib_handle, "SmartPredictor_save");
-    reset_func = (SmartPredictor_reset)dlsym(lib_handle, "SmartPredictor_reset");
-    delete_func = (SmartPredictor_delete)dlsym(lib_handle, "SmartPredictor_delete");
-    sign_func = (SmartPredictor_sign)dlsym(lib_handle, "SmartPredictor_sign");
-
-    return load_func && unload_func && predict_func && regist_func && 
-           save_func && reset_func && sign_func && delete_func;
-}
-
-std::vector<unsigned char> readImage(const std::string& filePath) {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open image file: " + filePath);
+// One checkout lane of the multi-lane demo, with its own handle; avgMs is -1 on failure
+void runLane(int lane, double* avgMs) {
+    *avgMs = -1.0;
+    SmartPredictor* handle = predictorCreate(MODEL_DIR, MODEL_TYPE);
+    if (!handle) {
+        return;
     }
-
-    file.seekg(0, std::ios::end);
-    std::streamoff fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    std::vector<unsigned char> buffer(static_cast<size_t>(fileSize));
-    file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(fileSize));
-    
-    if (!file) {
-        throw std::runtime_error("Failed to read image file: " + filePath);
+    try {
+        std::vector<unsigned char> imageData = testImage();
+        char buffer[1024];
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < LANE_PREDICTIONS; ++i) {
+            predictorPredict(handle, imageData.data(), static_cast<long>(imageData.size()),
+                             PREDICTION_THRESHOLD, buffer, sizeof(buffer));
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        *avgMs = std::chrono::duration<double, std::milli>(end - start).count() / LANE_PREDICTIONS;
+    } catch (const std::exception& e) {
+        std::cerr << "Lane " << lane << ": " << e.what() << std::endl;
     }
+    predictorDestroy(handle);
+}
 
-    return buffer;
+/**
+ * Encoded test image, read from disk once and kept in memory so repeated
+ * predictions measure the SDK rather than file I/O.
+ */
+std::vector<unsigned char>& testImage() {
+    static std::vector<unsigned char> image = readImage(TEST_IMAGE_PATH);
+    return image;
 }
 
 // Linux implementation of getch()
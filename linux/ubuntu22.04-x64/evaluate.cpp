@@ -0,0 +1,409 @@
+/**
+ * @file evaluate.cpp
+ * @brief Compare a candidate model (e.g. an int8 backbone) with the reference model on a local image set (Linux version)
+ * @note Build: g++ -std=c++11 evaluate.cpp smart_predictor.cpp -o evaluate -ldl -pthread
+ *
+ * Usage: ./evaluate <image_dir> --candidate DIR[:TYPE] [--reference DIR[:TYPE]] [--regist-per-label K]
+ *
+ * image_dir holds one sub-directory per label with the images of that label,
+ * e.g. image_dir/apple/1.jpg. A model is a model directory and the
+ * model_type passed to SmartPredictor_load (default SMART_PREDICTOR_MODEL_TYPE,
+ * else DEFAULT_MODEL_TYPE). The SDK
+ * holds one model per process, so each model is evaluated in a child
+ * process of its own, from a scratch copy of its directory. Both children
+ * start from the same state, so rss_kb of one model does not include
+ * memory the other left behind.
+ *
+ * Gallery features depend on the backbone, so a candidate directory seldom
+ * carries a usable gallery. With --regist-per-label K both galleries are
+ * reset and rebuilt from the first K images of each label, and only the
+ * remaining images are predicted. Latency, model size, accuracy against the
+ * directory labels, and top-1/top-5 agreement of the candidate with the
+ * reference are written to stdout as JSON.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <cstdlib>
+#include <cerrno>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "smart_predictor.h"
+
+// Configuration parameters
+const char* DEFAULT_MODEL_DIR = "./model";
+const int MODEL_TYPE = modelTypeFromEnv();  // model_type of SmartPredictor_load, see modelTypeFromEnv()
+const int REGIST_POS = 6;
+const int TOP_K = 5;  // Candidates compared for top-5 agreement
+const int WARMUP_ROUNDS = 3;  // Untimed predictions after each load
+
+// One labelled image of the corpus
+struct CorpusImage {
+    std::string label;
+    std::vector<unsigned char> bytes;
+    bool gallery;  // Registered when the galleries are rebuilt, not predicted
+};
+
+// Model under evaluation and what it predicted
+struct ModelRun {
+    std::string dir;
+    int modelType;
+    double loadMs;
+    std::vector<double> latenciesMs;
+    std::vector<std::vector<std::string> > topLabels;  // Best first, per predicted image
+    int errors;
+    long rssKb;
+    long long paramsBytes;
+    long long modelBytes;
+};
+
+// Function declarations
+std::vector<CorpusImage> readCorpus(const std::string& dir, int registPerLabel);
+bool parseModel(const std::string& spec, ModelRun* run);
+bool evaluateModel(ModelRun* run, std::vector<CorpusImage>& corpus, int registPerLabel);
+bool evaluateInChild(ModelRun* run, std::vector<CorpusImage>& corpus, int registPerLabel);
+std::string encodeRun(const ModelRun& run);
+bool decodeRun(const std::string& text, ModelRun* run);
+void printRun(const char* name, const ModelRun& run, const std::vector<CorpusImage>& corpus);
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <image_dir> --candidate DIR[:TYPE] [--reference DIR[:TYPE]] [--regist-per-label K]" << std::endl;
+        return -1;
+    }
+    std::string imageDir = argv[1];
+    ModelRun reference = ModelRun();
+    ModelRun candidate = ModelRun();
+    bool hasReference = parseModel(DEFAULT_MODEL_DIR, &reference);
+    bool hasCandidate = false;
+    int registPerLabel = 0;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--candidate") {
+            hasCandidate = parseModel(argv[i + 1], &candidate);
+        } else if (option == "--reference") {
+            hasReference = parseModel(argv[i + 1], &reference);
+            if (!hasReference) {
+                std::cerr << "Invalid model: " << argv[i + 1] << std::endl;
+                return -1;
+            }
+        } else if (option == "--regist-per-label") {
+            registPerLabel = std::max(0, std::atoi(argv[i + 1]));
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return -1;
+        }
+    }
+    if (!hasCandidate) {
+        std::cerr << "A valid --candidate DIR[:TYPE] is required" << std::endl;
+        return -1;
+    }
+    if (!hasReference) {
+        std::cerr << "No reference model in " << DEFAULT_MODEL_DIR << "; pass --reference DIR[:TYPE]" << std::endl;
+        return -1;
+    }
+
+    if (!loadLibrary()) {
+        std::cerr << "Failed to load library: " << dlerror() << std::endl;
+        return -1;
+    }
+    if (!getFunctionPointers()) {
+        std::cerr << "Failed to get all required function pointers" << std::endl;
+        return -1;
+    }
+
+    std::vector<CorpusImage> corpus;
+    try {
+        corpus = readCorpus(imageDir, registPerLabel);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+    size_t predicted = 0;
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        predicted += corpus[i].gallery ? 0 : 1;
+    }
+    if (predicted == 0) {
+        std::cerr << "No images left to predict in " << imageDir << std::endl;
+        return -1;
+    }
+
+    if (!evaluateInChild(&reference, corpus, registPerLabel) || !evaluateInChild(&candidate, corpus, registPerLabel)) {
+        dlclose(lib_handle);
+        return -1;
+    }
+
+    // Agreement of the candidate with the reference, image by image
+    int compared = 0;
+    int top1 = 0;
+    int top5 = 0;
+    for (size_t i = 0; i < reference.topLabels.size(); ++i) {
+        const std::vector<std::string>& expected = reference.topLabels[i];
+        const std::vector<std::string>& actual = candidate.topLabels[i];
+        if (expected.empty()) {
+            continue;
+        }
+        ++compared;
+        if (!actual.empty() && actual[0] == expected[0]) {
+            ++top1;
+        }
+        if (std::find(actual.begin(), actual.end(), expected[0]) != actual.end()) {
+            ++top5;
+        }
+    }
+    double referenceP50 = percentile(reference.latenciesMs, 50);
+    double candidateP50 = percentile(candidate.latenciesMs, 50);
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"images\": " << corpus.size() << "," << std::endl;
+    std::cout << "  \"predicted_images\": " << predicted << "," << std::endl;
+    std::cout << "  \"regist_per_label\": " << registPerLabel << "," << std::endl;
+    printRun("reference", reference, corpus);
+    printRun("candidate", candidate, corpus);
+    std::cout << "  \"compared\": " << compared << "," << std::endl;
+    std::cout << "  \"top1_agreement\": " << (compared ? static_cast<double>(top1) / compared : 0.0) << "," << std::endl;
+    std::cout << "  \"top5_agreement\": " << (compared ? static_cast<double>(top5) / compared : 0.0) << "," << std::endl;
+    std::cout << "  \"predict_speedup\": " << (candidateP50 > 0 ? referenceP50 / candidateP50 : 0.0) << std::endl;
+    std::cout << "}" << std::endl;
+
+    dlclose(lib_handle);
+    return 0;
+}
+
+// Parse DIR[:TYPE]; false if DIR is not a directory or TYPE is not a number
+bool parseModel(const std::string& spec, ModelRun* run) {
+    size_t colon = spec.rfind(':');
+    run->dir = spec.substr(0, colon);
+    run->modelType = MODEL_TYPE;
+    if (colon != std::string::npos && !parseModelType(spec.c_str() + colon + 1, &run->modelType)) {
+        return false;
+    }
+    struct stat st;
+    return !run->dir.empty() && stat(run->dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/**
+ * Load one model from a scratch copy, optionally rebuild its gallery, and
+ * predict every non-gallery image of the corpus.
+ */
+bool evaluateModel(ModelRun* run, std::vector<CorpusImage>& corpus, int registPerLabel) {
+    char scratch[] = "/tmp/rx_evaluate_XXXXXX";
+    if (!mkdtemp(scratch) || !copyDirectory(run->dir, scratch)) {
+        std::cerr << "Failed to copy " << run->dir << " to a scratch directory" << std::endl;
+        return false;
+    }
+    run->paramsBytes = directorySize(run->dir + "/enc");
+    run->modelBytes = directorySize(run->dir);
+    // Empty the gallery before the load so the model starts without it
+    if (registPerLabel > 0 && !predictorReset(scratch)) {
+        std::cerr << "Failed to reset the gallery of " << run->dir << std::endl;
+        removeDirectory(scratch);
+        return false;
+    }
+
+    auto loadStart = std::chrono::high_resolution_clock::now();
+    SmartPredictor* handle = predictorCreate(scratch, run->modelType);
+    auto loadEnd = std::chrono::high_resolution_clock::now();
+    if (!handle) {
+        std::cerr << "Failed to load " << run->dir << " as model type " << run->modelType << std::endl;
+        removeDirectory(scratch);
+        return false;
+    }
+    run->loadMs = std::chrono::duration<double, std::milli>(loadEnd - loadStart).count();
+
+    for (size_t i = 0; registPerLabel > 0 && i < corpus.size(); ++i) {
+        if (corpus[i].gallery) {
+            predictorRegist(handle, corpus[i].bytes.data(), static_cast<long>(corpus[i].bytes.size()),
+                            corpus[i].label.c_str(), REGIST_POS);
+        }
+    }
+
+    size_t first = 0;
+    while (first < corpus.size() && corpus[first].gallery) {
+        ++first;
+    }
+    predictorWarmup(handle, corpus[first].bytes.data(), static_cast<long>(corpus[first].bytes.size()), WARMUP_ROUNDS);
+
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        if (corpus[i].gallery) {
+            continue;
+        }
+        PredictScore scores[MAX_SCORES];
+        int scoreCount = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        int result = predictScores(handle, corpus[i].bytes.data(), static_cast<long>(corpus[i].bytes.size()),
+                                   0.0f, scores, MAX_SCORES, &scoreCount);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::vector<std::string> labels;
+        if (result < 0) {
+            ++run->errors;
+            scoreCount = 0;
+        } else {
+            run->latenciesMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        std::sort(scores, scores + scoreCount,
+                  [](const PredictScore& a, const PredictScore& b) { return a.score > b.score; });
+        for (int s = 0; s < scoreCount && s < TOP_K; ++s) {
+            labels.push_back(labelName(scores[s].labelId));
+        }
+        run->topLabels.push_back(labels);
+    }
+    run->rssKb = memoryUsage().rssKb;
+
+    predictorSaveShutdown();
+    predictorDestroy(handle);
+    removeDirectory(scratch);
+    return true;
+}
+
+/**
+ * Run evaluateModel in a forked child, which exits after unloading, and
+ * read its results back over a pipe.
+ */
+bool evaluateInChild(ModelRun* run, std::vector<CorpusImage>& corpus, int registPerLabel) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        std::cerr << "Failed to create a pipe" << std::endl;
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Failed to start a process for " << run->dir << std::endl;
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        bool ok = evaluateModel(run, corpus, registPerLabel);
+        std::string encoded = ok ? encodeRun(*run) : std::string();
+        for (size_t written = 0; ok && written < encoded.size();) {
+            ssize_t n = write(fds[1], encoded.data() + written, encoded.size() - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            ok = n > 0;
+            written += ok ? static_cast<size_t>(n) : 0;
+        }
+        close(fds[1]);
+        _exit(ok ? 0 : 1);
+    }
+    close(fds[1]);
+    std::string encoded;
+    char buffer[4096];
+    for (;;) {
+        ssize_t n = read(fds[0], buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        encoded.append(buffer, static_cast<size_t>(n));
+    }
+    close(fds[0]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 && decodeRun(encoded, run);
+}
+
+// Measured fields of run as text; labels are length-prefixed since they may hold spaces
+std::string encodeRun(const ModelRun& run) {
+    std::ostringstream out;
+    out.precision(17);
+    out << run.loadMs << ' ' << run.errors << ' ' << run.rssKb << ' ' << run.paramsBytes << ' ' << run.modelBytes;
+    out << ' ' << run.latenciesMs.size();
+    for (size_t i = 0; i < run.latenciesMs.size(); ++i) {
+        out << ' ' << run.latenciesMs[i];
+    }
+    out << ' ' << run.topLabels.size();
+    for (size_t i = 0; i < run.topLabels.size(); ++i) {
+        out << ' ' << run.topLabels[i].size();
+        for (size_t l = 0; l < run.topLabels[i].size(); ++l) {
+            out << ' ' << run.topLabels[i][l].size() << ':' << run.topLabels[i][l];
+        }
+    }
+    return out.str();
+}
+
+bool decodeRun(const std::string& text, ModelRun* run) {
+    std::istringstream in(text);
+    size_t count = 0;
+    in >> run->loadMs >> run->errors >> run->rssKb >> run->paramsBytes >> run->modelBytes >> count;
+    run->latenciesMs.clear();
+    for (size_t i = 0; i < count && in; ++i) {
+        double latency = 0;
+        in >> latency;
+        run->latenciesMs.push_back(latency);
+    }
+    in >> count;
+    run->topLabels.clear();
+    for (size_t i = 0; i < count && in; ++i) {
+        size_t labels = 0;
+        in >> labels;
+        run->topLabels.push_back(std::vector<std::string>());
+        for (size_t l = 0; l < labels && in; ++l) {
+            size_t length = 0;
+            char colon = 0;
+            in >> length >> colon;
+            std::string label(length, '\0');
+            in.read(&label[0], static_cast<std::streamsize>(length));
+            run->topLabels.back().push_back(label);
+        }
+    }
+    return !in.fail();
+}
+
+void printRun(const char* name, const ModelRun& run, const std::vector<CorpusImage>& corpus) {
+    int top1 = 0;
+    int top5 = 0;
+    size_t predicted = 0;
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        if (corpus[i].gallery) {
+            continue;
+        }
+        const std::vector<std::string>& labels = run.topLabels[predicted++];
+        if (!labels.empty() && labels[0] == corpus[i].label) {
+            ++top1;
+        }
+        if (std::find(labels.begin(), labels.end(), corpus[i].label) != labels.end()) {
+            ++top5;
+        }
+    }
+    double count = predicted ? static_cast<double>(predicted) : 1.0;
+    std::cout << "  \"" << name << "\": {\"dir\": \"" << jsonEscape(run.dir) << "\", \"model_type\": " << run.modelType
+              << ", \"params_kb\": " << run.paramsBytes / 1024 << ", \"model_kb\": " << run.modelBytes / 1024
+              << ", \"load_ms\": " << run.loadMs << ", \"errors\": " << run.errors
+              << ", \"predict_p50_ms\": " << percentile(run.latenciesMs, 50)
+              << ", \"predict_p95_ms\": " << percentile(run.latenciesMs, 95)
+              << ", \"rss_kb\": " << run.rssKb
+              << ", \"top1_accuracy\": " << top1 / count << ", \"top5_accuracy\": " << top5 / count << "}," << std::endl;
+}
+
+// Read dir/<label>/<image> in name order; the first registPerLabel of each label form the gallery
+std::vector<CorpusImage> readCorpus(const std::string& dir, int registPerLabel) {
+    std::vector<std::pair<std::string, std::string> > files;
+    if (!listLabelFiles(dir, &files)) {
+        throw std::runtime_error("Failed to open image directory: " + dir);
+    }
+    std::vector<CorpusImage> images(files.size());
+    int taken = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        taken = i > 0 && files[i].second == files[i - 1].second ? taken + 1 : 0;
+        images[i].label = files[i].second;
+        images[i].bytes = readImage(files[i].first);
+        images[i].gallery = taken < registPerLabel;
+    }
+    return images;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file import.cpp
+ * @brief Seed a store's gallery from a directory of labelled reference photos (Linux version)
+ * @note Build: g++ -std=c++11 import.cpp smart_predictor.cpp -o import -ldl -pthread
+ *
+ * Usage: ./import <image_dir> [--threads N] [--model DIR]
+ *
+ * image_dir holds one sub-directory per label with the images of that label,
+ * e.g. image_dir/apple/1.jpg. The gallery in the model directory is saved
+ * once at the end. The report, including every file that failed, is written
+ * to stdout as JSON. SMART_PREDICTOR_MODEL_TYPE selects the model variant.
+ */
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <dlfcn.h>
+
+#include "smart_predictor.h"
+
+// Configuration parameters
+const char* DEFAULT_MODEL_DIR = "./model";
+const int MODEL_TYPE = modelTypeFromEnv();  // model_type of SmartPredictor_load, see modelTypeFromEnv()
+const int REGIST_POS = 6;
+
+// Function declarations
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <image_dir> [--threads N] [--model DIR]" << std::endl;
+        return -1;
+    }
+    std::string imageDir = argv[1];
+    std::string modelDir = DEFAULT_MODEL_DIR;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--threads") {
+            threads = std::max(1, std::atoi(argv[i + 1]));
+        } else if (option == "--model") {
+            modelDir = argv[i + 1];
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return -1;
+        }
+    }
+
+    if (!loadLibrary()) {
+        std::cerr << "Failed to load library: " << dlerror() << std::endl;
+        return -1;
+    }
+    if (!getFunctionPointers()) {
+        std::cerr << "Failed to get all required function pointers" << std::endl;
+        return -1;
+    }
+
+    SmartPredictor* handle = predictorCreate(modelDir.c_str(), MODEL_TYPE);
+    if (!handle) {
+        std::cerr << "Failed to load model" << std::endl;
+        dlclose(lib_handle);
+        return -1;
+    }
+
+    ImportReport report;
+    int imported = predictorImport(handle, imageDir.c_str(), REGIST_POS, threads, &report);
+    if (imported < 0) {
+        std::cerr << "Failed to open image directory: " << imageDir << std::endl;
+    } else {
+        std::cout << "{\"files\": " << report.files << ", \"imported\": " << report.imported
+                  << ", \"failed\": " << report.failures.size() << ", \"seconds\": " << report.seconds
+                  << ", \"images_per_second\": " << (report.seconds > 0 ? report.imported / report.seconds : 0.0)
+                  << ", \"save_result\": " << report.saveResult << ", \"failures\": [";
+        for (size_t i = 0; i < report.failures.size(); ++i) {
+            std::cout << (i ? ", " : "") << "{\"path\": \"" << jsonEscape(report.failures[i].path)
+                      << "\", \"result\": " << report.failures[i].result << "}";
+        }
+        std::cout << "]}" << std::endl;
+    }
+
+    predictorSaveShutdown();
+    predictorDestroy(handle);
+    dlclose(lib_handle);
+    return imported < 0 || report.saveResult < 0 ? -1 : 0;
+}
@@ -0,0 +1,241 @@
+/**
+ * @file jpeg_prep.cpp
+ * @brief Shrink camera JPEGs before they reach the SDK (Linux version)
+ */
+
+#include "jpeg_prep.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <csetjmp>
+#include <algorithm>
+#include <jpeglib.h>
+
+// libjpeg reports errors through error_exit, which must not return
+struct PrepError {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+static void prepErrorExit(j_common_ptr cinfo) {
+    longjmp(reinterpret_cast<PrepError*>(cinfo->err)->jump, 1);
+}
+
+static void prepSilence(j_common_ptr) {
+}
+
+/**
+ * Decode, crop and encode row by row, so only one scanline of the scaled
+ * frame is ever held. Kept free of C++ objects because of the longjmp.
+ * @return 0 with *out malloc'd by libjpeg, 1 for pass-through, -1 on error
+ */
+static int transcode(const unsigned char* imgBytes, unsigned long byteSize, const PrepOptions* options,
+                     unsigned char** out, unsigned long* outSize, PrepInfo* info) {
+    struct jpeg_decompress_struct dinfo;
+    struct jpeg_compress_struct cinfo;
+    PrepError error;  // Shared by both objects so one jump target covers them
+    volatile bool compressing = false;
+    dinfo.err = jpeg_std_error(&error.pub);
+    cinfo.err = &error.pub;
+    error.pub.error_exit = prepErrorExit;
+    error.pub.output_message = prepSilence;
+    *out = nullptr;
+    *outSize = 0;
+
+    jpeg_create_decompress(&dinfo);
+    if (setjmp(error.jump)) {
+        if (compressing) {
+            jpeg_destroy_compress(&cinfo);
+        }
+        jpeg_destroy_decompress(&dinfo);
+        std::free(*out);
+        *out = nullptr;
+        return -1;
+    }
+    jpeg_mem_src(&dinfo, imgBytes, byteSize);
+    jpeg_read_header(&dinfo, TRUE);
+    info->srcWidth = static_cast<int>(dinfo.image_width);
+    info->srcHeight = static_cast<int>(dinfo.image_height);
+
+    // Clip the region to the frame
+    int rx = std::max(0, std::min(options->roi.x, info->srcWidth - 1));
+    int ry = std::max(0, std::min(options->roi.y, info->srcHeight - 1));
+    int rw = options->roi.width > 0 ? std::min(options->roi.width, info->srcWidth - rx) : info->srcWidth - rx;
+    int rh = options->roi.height > 0 ? std::min(options->roi.height, info->srcHeight - ry) : info->srcHeight - ry;
+    bool cropped = rw < info->srcWidth || rh < info->srcHeight;
+    int denom = 1;
+    for (int d = 8; d > 1; d /= 2) {
+        if (std::min(rw, rh) / d >= options->minSide) {
+            denom = d;
+            break;
+        }
+    }
+    info->scaleDenom = denom;
+    if ((denom == 1 && !cropped) || dinfo.jpeg_color_space == JCS_CMYK || dinfo.jpeg_color_space == JCS_YCCK) {
+        jpeg_destroy_decompress(&dinfo);
+        return 1;
+    }
+
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = static_cast<unsigned int>(denom);
+    dinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&dinfo);
+    JDIMENSION sx = static_cast<JDIMENSION>(rx / denom);
+    JDIMENSION sy = static_cast<JDIMENSION>(ry / denom);
+    JDIMENSION sw = std::min(static_cast<JDIMENSION>((rw + denom - 1) / denom), dinfo.output_width - sx);
+    JDIMENSION sh = std::min(static_cast<JDIMENSION>((rh + denom - 1) / denom), dinfo.output_height - sy);
+    // Horizontal cropping starts at an iMCU boundary; the rest is skipped per row
+    JDIMENSION xoffset = sx;
+    JDIMENSION cropWidth = sw;
+    if (sw < dinfo.output_width) {
+        jpeg_crop_scanline(&dinfo, &xoffset, &cropWidth);
+    }
+    JDIMENSION shift = sx - xoffset;
+    if (sy > 0) {
+        jpeg_skip_scanlines(&dinfo, sy);
+    }
+
+    jpeg_create_compress(&cinfo);
+    compressing = true;
+    jpeg_mem_dest(&cinfo, out, outSize);
+    cinfo.image_width = sw;
+    cinfo.image_height = sh;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, options->quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    JSAMPARRAY row = (*dinfo.mem->alloc_sarray)(reinterpret_cast<j_common_ptr>(&dinfo), JPOOL_IMAGE,
+                                                dinfo.output_width * 3, 1);
+    for (JDIMENSION y = 0; y < sh; ++y) {
+        jpeg_read_scanlines(&dinfo, row, 1);
+        JSAMPROW pixels = row[0] + shift * 3;
+        jpeg_write_scanlines(&cinfo, &pixels, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    jpeg_abort_decompress(&dinfo);
+    jpeg_destroy_decompress(&dinfo);
+    info->outWidth = static_cast<int>(sw);
+    info->outHeight = static_cast<int>(sh);
+    return 0;
+}
+
+/**
+ * Accumulate 1/8-scale luma of the region into grid x grid cell sums.
+ * Same longjmp constraint as transcode().
+ */
+static bool thumbnail(const unsigned char* imgBytes, unsigned long byteSize, const PrepRegion* roi, int grid,
+                      unsigned long* sums, unsigned long* counts) {
+    struct jpeg_decompress_struct dinfo;
+    PrepError error;
+    dinfo.err = jpeg_std_error(&error.pub);
+    error.pub.error_exit = prepErrorExit;
+    error.pub.output_message = prepSilence;
+
+    jpeg_create_decompress(&dinfo);
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&dinfo);
+        return false;
+    }
+    jpeg_mem_src(&dinfo, imgBytes, byteSize);
+    jpeg_read_header(&dinfo, TRUE);
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = 8;
+    dinfo.out_color_space = JCS_GRAYSCALE;
+    dinfo.dct_method = JDCT_IFAST;
+    dinfo.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&dinfo);
+
+    int width = static_cast<int>(dinfo.output_width);
+    int height = static_cast<int>(dinfo.output_height);
+    int rx = std::max(0, std::min(roi->x / 8, width - 1));
+    int ry = std::max(0, std::min(roi->y / 8, height - 1));
+    int rw = roi->width > 0 ? std::max(1, std::min((roi->width + 7) / 8, width - rx)) : width - rx;
+    int rh = roi->height > 0 ? std::max(1, std::min((roi->height + 7) / 8, height - ry)) : height - ry;
+    JSAMPARRAY row = (*dinfo.mem->alloc_sarray)(reinterpret_cast<j_common_ptr>(&dinfo), JPOOL_IMAGE,
+                                                dinfo.output_width, 1);
+    for (int y = 0; y < ry + rh; ++y) {
+        jpeg_read_scanlines(&dinfo, row, 1);
+        if (y < ry) {
+            continue;
+        }
+        int cellRow = (y - ry) * grid / rh;
+        for (int x = 0; x < rw; ++x) {
+            int cell = cellRow * grid + x * grid / rw;
+            sums[cell] += row[0][rx + x];
+            ++counts[cell];
+        }
+    }
+    jpeg_abort_decompress(&dinfo);
+    jpeg_destroy_decompress(&dinfo);
+    return true;
+}
+
+int prepareJpeg(const unsigned char* imgBytes, long byteSize, const PrepOptions& options,
+                std::vector<unsigned char>* out, PrepInfo* info) {
+    info->srcWidth = 0;
+    info->srcHeight = 0;
+    info->outWidth = 0;
+    info->outHeight = 0;
+    info->scaleDenom = 1;
+    if (byteSize < 4 || imgBytes[0] != 0xFF || imgBytes[1] != 0xD8) {
+        return 1;
+    }
+    unsigned char* encoded = nullptr;
+    unsigned long encodedSize = 0;
+    int result = transcode(imgBytes, static_cast<unsigned long>(byteSize), &options, &encoded, &encodedSize, info);
+    if (result == 1) {
+        info->outWidth = info->srcWidth;
+        info->outHeight = info->srcHeight;
+    }
+    if (result == 0) {
+        out->assign(encoded, encoded + encodedSize);
+    }
+    std::free(encoded);
+    return result;
+}
+
+bool jpegThumbnail(const unsigned char* imgBytes, long byteSize, const PrepRegion& roi, int grid,
+                   std::vector<unsigned char>* cells) {
+    if (byteSize < 4 || imgBytes[0] != 0xFF || imgBytes[1] != 0xD8 || grid <= 0) {
+        return false;
+    }
+    std::vector<unsigned long> sums(grid * grid, 0);
+    std::vector<unsigned long> counts(grid * grid, 0);
+    if (!thumbnail(imgBytes, static_cast<unsigned long>(byteSize), &roi, grid, sums.data(), counts.data())) {
+        return false;
+    }
+    cells->assign(grid * grid, 0);
+    for (int i = 0; i < grid * grid; ++i) {
+        (*cells)[i] = static_cast<unsigned char>(counts[i] ? sums[i] / counts[i] : 0);
+    }
+    return true;
+}
+
+bool jpegSize(const unsigned char* imgBytes, long byteSize, int* width, int* height) {
+    // Walk the marker segments up to the first start-of-frame
+    if (byteSize < 4 || imgBytes[0] != 0xFF || imgBytes[1] != 0xD8) {
+        return false;
+    }
+    long offset = 2;
+    while (offset + 4 <= byteSize) {
+        if (imgBytes[offset] != 0xFF) {
+            return false;
+        }
+        unsigned char marker = imgBytes[offset + 1];
+        if (marker == 0xFF) {
+            ++offset;
+            continue;
+        }
+        long length = (imgBytes[offset + 2] << 8) | imgBytes[offset + 3];
+        bool startOfFrame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (startOfFrame && offset + 9 <= byteSize) {
+            *height = (imgBytes[offset + 5] << 8) | imgBytes[offset + 6];
+            *width = (imgBytes[offset + 7] << 8) | imgBytes[offset + 8];
+            return true;
+        }
+        offset += 2 + length;
+    }
+    return false;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file jpeg_prep.h
+ * @brief Shrink camera JPEGs before they reach the SDK (Linux version)
+ *
+ * The SDK decodes every frame at full size before resizing it to the
+ * network input. prepareJpeg() decodes with libjpeg's DCT-domain scaling
+ * (1/2, 1/4 or 1/8) to the smallest size that still keeps the shorter side
+ * at or above the requested minimum, optionally crops a region of interest,
+ * and re-encodes the result, so the SDK only ever decodes a small image.
+ * Link with -ljpeg (libjpeg-turbo 1.5 or later).
+ */
+
+#ifndef JPEG_PREP_H
+#define JPEG_PREP_H
+
+#include <vector>
+
+// Configuration parameters
+const int PREP_MIN_SIDE = 400;  // Shorter side kept after scaling; the SDK documentation asks for more than 400x400
+const int PREP_QUALITY = 92;  // Quality of the re-encoded frame
+
+// Region of the source frame in source pixels; a width or height of 0 means the whole frame
+struct PrepRegion {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+struct PrepOptions {
+    int minSide;
+    PrepRegion roi;
+    int quality;
+};
+
+// Geometry of a prepared frame
+struct PrepInfo {
+    int srcWidth;
+    int srcHeight;
+    int outWidth;
+    int outHeight;
+    int scaleDenom;  // 1, 2, 4 or 8
+};
+
+/**
+ * Scale and crop a JPEG for prediction.
+ * @return 0 if out holds the prepared frame, 1 if the input should be used
+ *         as is (not a JPEG, CMYK, or nothing to gain), -1 if it is corrupt
+ */
+int prepareJpeg(const unsigned char* imgBytes, long byteSize, const PrepOptions& options,
+                std::vector<unsigned char>* out, PrepInfo* info);
+
+// Frame size from the JPEG header, without decoding
+bool jpegSize(const unsigned char* imgBytes, long byteSize, int* width, int* height);
+
+/**
+ * Mean luma of a grid x grid cells over the region, decoded at 1/8 scale.
+ * Cheap enough to run on every camera frame for change detection.
+ * @return false if the image is not a readable JPEG
+ */
+bool jpegThumbnail(const unsigned char* imgBytes, long byteSize, const PrepRegion& roi, int grid,
+                   std::vector<unsigned char>* cells);
+
+#endif // JPEG_PREP_H
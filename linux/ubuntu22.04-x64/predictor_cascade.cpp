@@ -0,0 +1,88 @@
+/**
+ * @file predictor_cascade.cpp
+ * @brief Two-stage prediction that skips the full-resolution pass for confident frames (Linux version)
+ */
+
+#include "predictor_cascade.h"
+
+#include <chrono>
+#include <vector>
+#include <map>
+
+// Lead of the best label over the best different label; scores may repeat a label
+static float labelMargin(const PredictScore* scores, int scoreCount) {
+    std::map<int, float> best;
+    for (int i = 0; i < scoreCount; ++i) {
+        std::map<int, float>::iterator it = best.find(scores[i].labelId);
+        if (it == best.end() || scores[i].score > it->second) {
+            best[scores[i].labelId] = scores[i].score;
+        }
+    }
+    float first = 0.0f;
+    float second = 0.0f;
+    for (std::map<int, float>::const_iterator it = best.begin(); it != best.end(); ++it) {
+        if (it->second > first) {
+            second = first;
+            first = it->second;
+        } else if (it->second > second) {
+            second = it->second;
+        }
+    }
+    return first - second;
+}
+
+int predictCascade(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, float filterSim,
+                   const CascadeOptions& options, PredictScore* scores, int maxScores, int* scoreCount,
+                   CascadeReport* report) {
+    CascadeReport local;
+    if (!report) {
+        report = &local;
+    }
+    report->stage = CASCADE_FULL;
+    report->firstMargin = -1.0f;
+    report->firstMs = 0.0;
+    report->fullMs = 0.0;
+
+    PrepOptions prep = { options.firstSide, options.roi, PREP_QUALITY };
+    std::vector<unsigned char> reduced;
+    PrepInfo info;
+    auto start = std::chrono::high_resolution_clock::now();
+    if (prepareJpeg(imgBytes, byteSize, prep, &reduced, &info) == 0) {
+        // The runner-up is only visible without the caller's threshold
+        int result = predictScores(handle, reduced.data(), static_cast<long>(reduced.size()), 0.0f,
+                                   scores, maxScores, scoreCount);
+        report->firstMs = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+        if (result >= 0) {
+            report->firstMargin = labelMargin(scores, *scoreCount);
+            if (*scoreCount > 0 && report->firstMargin >= options.margin) {
+                int kept = 0;
+                for (int i = 0; i < *scoreCount; ++i) {
+                    if (scores[i].score >= filterSim) {
+                        scores[kept++] = scores[i];
+                    }
+                }
+                *scoreCount = kept;
+                report->stage = CASCADE_FIRST;
+                return result;
+            }
+        }
+    }
+
+    // Full resolution, still cropped to the region of interest
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<unsigned char> cropped;
+    unsigned char* bytes = imgBytes;
+    long size = byteSize;
+    if (options.roi.width > 0 && options.roi.height > 0) {
+        PrepOptions crop = { 65536, options.roi, PREP_QUALITY };  // Above any JPEG dimension: crop without scaling
+        if (prepareJpeg(imgBytes, byteSize, crop, &cropped, &info) == 0) {
+            bytes = cropped.data();
+            size = static_cast<long>(cropped.size());
+        }
+    }
+    int result = predictScores(handle, bytes, size, filterSim, scores, maxScores, scoreCount);
+    report->fullMs = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file predictor_cascade.h
+ * @brief Two-stage prediction that skips the full-resolution pass for confident frames (Linux version)
+ *
+ * The first stage predicts on a frame shrunk by prepareJpeg() to
+ * firstSide, which avoids most of the SDK's decode and resize cost on
+ * camera-sized JPEGs. If its best label leads the runner-up by at least
+ * the margin, that answer is returned; ambiguous frames are predicted
+ * again at full resolution. Link with jpeg_prep.cpp and -ljpeg.
+ */
+
+#ifndef PREDICTOR_CASCADE_H
+#define PREDICTOR_CASCADE_H
+
+#include "smart_predictor.h"
+#include "jpeg_prep.h"
+
+// Configuration parameters
+const float CASCADE_MARGIN = 0.15f;  // Lead of the best label over the runner-up at which the first stage answers
+const int CASCADE_FIRST_SIDE = 224;  // Shorter side of the first-stage frame, about the network input size
+
+// Which stage produced the scores of predictCascade
+enum CascadeStage {
+    CASCADE_FIRST,  // Reduced-resolution frame was confident enough
+    CASCADE_FULL    // Ambiguous, or the frame could not be reduced
+};
+
+struct CascadeOptions {
+    float margin;
+    int firstSide;
+    PrepRegion roi;  // Applied to both stages; zero width or height for the whole frame
+};
+
+// Per-call report, for tuning the margin against latency
+struct CascadeReport {
+    CascadeStage stage;
+    float firstMargin;  // Lead measured by the first stage; -1 if it did not run
+    double firstMs;     // Prepare plus first-stage predict
+    double fullMs;      // Full-resolution predict; 0 if skipped
+};
+
+/**
+ * Predict like predictScores(), trying the reduced frame first.
+ * @return the predictScores result of the stage that answered
+ */
+int predictCascade(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, float filterSim,
+                   const CascadeOptions& options, PredictScore* scores, int maxScores, int* scoreCount,
+                   CascadeReport* report);
+
+#endif // PREDICTOR_CASCADE_H
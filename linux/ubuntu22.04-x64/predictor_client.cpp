@@ -0,0 +1,265 @@
+/**
+ * @file predictor_client.cpp
+ * @brief Drop-in replacement for libsmart_predictor_jni.so that forwards every call to the predictor daemon
+ * @note Build: g++ -std=c++11 -shared -fPIC predictor_client.cpp predictor_ipc.cpp -o libsmart_predictor_client.so -pthread
+ *
+ * Exports the SDK's C entry points with unchanged signatures, so an application
+ * switches to the shared model by loading this library instead of the SDK.
+ * Images are copied once into a memfd that is reused across calls and handed
+ * to the daemon as a descriptor; the socket only carries headers and results.
+ * The daemon keeps one session per connection, so after a reconnect the last
+ * SmartPredictor_load is sent again before the call that found the daemon gone.
+ */
+
+#include "predictor_ipc.h"
+
+#include <string>
+#include <mutex>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+// Kept static so they cannot clash with symbols of the application loading this library
+static std::mutex client_mutex;  // One request in flight per process
+static int daemon_fd = -1;
+static int image_fd = -1;  // memfd reused for every image sent
+static long image_capacity = 0;  // Size of image_fd; it only grows
+static bool session_loaded = false;  // SmartPredictor_load succeeded and no unload followed
+static std::string session_dir;  // Arguments of that load, replayed after a reconnect
+static int session_type = 0;
+
+// Connect on first use, and again after the daemon restarted
+static bool connectDaemon() {
+    if (daemon_fd >= 0) {
+        return true;
+    }
+    const char* path = std::getenv("SMART_PREDICTOR_SOCKET");
+    if (!path || !*path) {
+        path = DAEMON_SOCKET_PATH;
+    }
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    std::strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return false;
+    }
+    daemon_fd = fd;
+    return true;
+}
+
+static void disconnectDaemon() {
+    if (daemon_fd >= 0) {
+        close(daemon_fd);
+        daemon_fd = -1;
+    }
+}
+
+/**
+ * Place the image in the shared memfd, growing it when needed. The memfd is
+ * sealed against shrinking, which the daemon checks, so its mapping can never
+ * lose pages under it; the image size travels in the request instead.
+ */
+static bool stageImage(const unsigned char* imgBytes, long byteSize) {
+    if (image_fd < 0) {
+        image_fd = memfd_create("smart_predictor_image", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (image_fd < 0) {
+            return false;
+        }
+        if (fcntl(image_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) != 0) {
+            close(image_fd);
+            image_fd = -1;
+            return false;
+        }
+        image_capacity = 0;
+    }
+    if (byteSize > image_capacity) {
+        if (ftruncate(image_fd, byteSize) != 0) {
+            return false;
+        }
+        image_capacity = byteSize;
+    }
+    long written = 0;
+    while (written < byteSize) {
+        ssize_t n = pwrite(image_fd, imgBytes + written, static_cast<size_t>(byteSize - written), written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+// Directories are resolved here because the daemon runs from its own working directory
+static std::string resolvePath(const char* path) {
+    char resolved[PATH_MAX];
+    return path && realpath(path, resolved) ? std::string(resolved) : std::string(path ? path : "");
+}
+
+static IpcRequest makeRequest(IpcOp op) {
+    IpcRequest request;
+    std::memset(&request, 0, sizeof(request));
+    request.op = op;
+    return request;
+}
+
+/**
+ * Exchange one request and response on the open connection. unsent is set
+ * when the connection broke before the whole request went out, in which
+ * case the daemon cannot have acted on it.
+ */
+static int exchange(IpcRequest& request, const std::string& text1, const std::string& text2,
+                    char* result, long resultSize, bool* unsent) {
+    request.text1Length = static_cast<uint32_t>(text1.size());
+    request.text2Length = static_cast<uint32_t>(text2.size());
+    *unsent = !ipcSendRequest(daemon_fd, request, request.hasImage ? image_fd : -1) ||
+              !ipcSendAll(daemon_fd, text1.data(), text1.size()) ||
+              !ipcSendAll(daemon_fd, text2.data(), text2.size());
+    IpcResponse response;
+    if (*unsent || !ipcRecvAll(daemon_fd, &response, sizeof(response))) {
+        disconnectDaemon();
+        return IPC_ERROR;
+    }
+    // Drain the payload even when the caller's buffer is smaller, keeping the stream in step
+    for (uint32_t received = 0; received < response.payloadLength;) {
+        char chunk[4096];
+        uint32_t n = std::min<uint32_t>(sizeof(chunk), response.payloadLength - received);
+        if (!ipcRecvAll(daemon_fd, chunk, n)) {
+            disconnectDaemon();
+            return IPC_ERROR;
+        }
+        if (result && static_cast<long>(received) < resultSize) {
+            std::memcpy(result + received, chunk, std::min<long>(n, resultSize - received));
+        }
+        received += n;
+    }
+    if (result && resultSize > 0 && response.payloadLength > 0) {
+        result[std::min<long>(response.payloadLength, resultSize) - 1] = '\0';
+    }
+    return response.result;
+}
+
+/**
+ * Send one request and wait for its response. A broken connection is dropped
+ * and a new one is opened, loading the session's model on it first. A request
+ * the old connection could not even send is retried once on the new one;
+ * otherwise the call fails and the next call reconnects.
+ */
+static int callDaemon(IpcRequest& request, const std::string& text1, const std::string& text2,
+                      char* result, long resultSize) {
+    if (text1.size() > IPC_MAX_TEXT || text2.size() > IPC_MAX_TEXT) {
+        return IPC_ERROR;
+    }
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        bool reconnecting = daemon_fd < 0;
+        bool unsent = false;
+        if (!connectDaemon()) {
+            return IPC_ERROR;
+        }
+        if (reconnecting && session_loaded && request.op != IPC_LOAD) {
+            IpcRequest load = makeRequest(IPC_LOAD);
+            load.pos = session_type;
+            if (exchange(load, session_dir, "", nullptr, 0, &unsent) < 0) {
+                disconnectDaemon();
+                return IPC_ERROR;
+            }
+        }
+        int code = exchange(request, text1, text2, result, resultSize, &unsent);
+        if (!unsent || reconnecting) {
+            return code;
+        }
+    }
+    return IPC_ERROR;
+}
+
+extern "C" {
+
+int SmartPredictor_load(const char* modelDir, int modelType) {
+    std::lock_guard<std::mutex> lock(client_mutex);
+    IpcRequest request = makeRequest(IPC_LOAD);
+    request.pos = modelType;
+    std::string dir = resolvePath(modelDir);
+    int result = callDaemon(request, dir, "", nullptr, 0);
+    session_loaded = result >= 0;
+    session_dir = dir;
+    session_type = modelType;
+    return result;
+}
+
+int SmartPredictor_unload() {
+    std::lock_guard<std::mutex> lock(client_mutex);
+    session_loaded = false;
+    IpcRequest request = makeRequest(IPC_UNLOAD);
+    int result = callDaemon(request, "", "", nullptr, 0);
+    disconnectDaemon();
+    return result;
+}
+
+int SmartPredictor_predict_img(unsigned char* imgBytes, long byteSize, float filterSim, char* result, long resultSize) {
+    std::lock_guard<std::mutex> lock(client_mutex);
+    if (!stageImage(imgBytes, byteSize)) {
+        return IPC_ERROR;
+    }
+    IpcRequest request = makeRequest(IPC_PREDICT);
+    request.filterSim = filterSim;
+    request.hasImage = 1;
+    request.byteSize = byteSize;
+    request.resultSize = resultSize;
+    return callDaemon(request, "", "", result, resultSize);
+}
+
+int SmartPredictor_regist_img(unsigned char* imgBytes, long byteSize, const char* label, int pos) {
+    std::lock_guard<std::mutex> lock(client_mutex);
+    if (!stageImage(imgBytes, byteSize)) {
+        return IPC_ERROR;
+    }
+    IpcRequest request = makeRequest(IPC_REGIST);
+    request.pos = pos;
+    request.hasImage = 1;
+    request.byteSize = byteSize;
+    return callDaemon(request, label ? label : "", "", nullptr, 0);
+}
+
+int SmartPredictor_save(const char* modelDir) {
+    std::lock_guard<std::mutex> lock(client_mutex);
+    IpcRequest request = makeRequest(IPC_SAVE);
+    return callDaemon(request, resolvePath(modelDir), "", nullptr, 0);
+}
+
+bool SmartPredictor_reset(const char* modelDir) {
+    std::lock_guard<std::mutex> lock(client_mutex);
+    IpcRequest request = makeRequest(IPC_RESET);
+    return callDaemon(request, resolvePath(modelDir), "", nullptr, 0) == 1;
+}
+
+bool SmartPredictor_delete(const char* label) {
+    std::lock_guard<std::mutex> lock(client_mutex);
+    IpcRequest request = makeRequest(IPC_DELETE);
+    return callDaemon(request, label ? label : "", "", nullptr, 0) == 1;
+}
+
+int SmartPredictor_sign(const char* modelDir, const char* authCode) {
+    std::lock_guard<std::mutex> lock(client_mutex);
+    IpcRequest request = makeRequest(IPC_SIGN);
+    return callDaemon(request, resolvePath(modelDir), authCode ? authCode : "", nullptr, 0);
+}
+
+}
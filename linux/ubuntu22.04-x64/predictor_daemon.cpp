@@ -0,0 +1,272 @@
+/**
+ * @file predictor_daemon.cpp
+ * @brief Serves one loaded model to several processes over a Unix domain socket
+ */
+
+#include "predictor_ipc.h"
+#include "smart_predictor.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <cstring>
+#include <climits>
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+// Set from SIGINT/SIGTERM; the accept loop polls it
+volatile sig_atomic_t daemon_stop = 0;
+
+std::mutex client_mutex;
+std::map<int, std::thread> client_threads;  // Connection fd -> serving thread
+std::vector<int> finished_clients;          // Connections whose thread has returned and can be joined
+
+static void onDaemonSignal(int) {
+    daemon_stop = 1;
+}
+
+// Read the text argument that follows a request header
+static bool recvText(int fd, uint32_t length, std::string* text) {
+    if (length > IPC_MAX_TEXT) {
+        return false;
+    }
+    text->assign(length, '\0');
+    return length == 0 || ipcRecvAll(fd, &(*text)[0], length);
+}
+
+static bool sendResponse(int fd, int result, const char* payload, uint32_t payloadLength) {
+    IpcResponse response;
+    response.result = result;
+    response.payloadLength = payloadLength;
+    return ipcSendAll(fd, &response, sizeof(response)) &&
+           (payloadLength == 0 || ipcSendAll(fd, payload, payloadLength));
+}
+
+/**
+ * Map the image a client passed as a memfd. The mapping is private so the
+ * SDK's non-const image pointer can never write back into the client's pages.
+ * Only memfds sealed against shrinking are accepted: a client truncating the
+ * file under the mapping would otherwise crash the daemon with SIGBUS.
+ */
+static unsigned char* mapImage(int imageFd, int64_t byteSize) {
+    struct stat st;
+    int seals = imageFd >= 0 ? fcntl(imageFd, F_GET_SEALS) : -1;
+    if (seals < 0 || !(seals & F_SEAL_SHRINK) || byteSize <= 0 || fstat(imageFd, &st) != 0 ||
+        st.st_size < byteSize) {
+        return nullptr;
+    }
+    void* image = mmap(nullptr, static_cast<size_t>(byteSize), PROT_READ | PROT_WRITE, MAP_PRIVATE, imageFd, 0);
+    return image == MAP_FAILED ? nullptr : static_cast<unsigned char*>(image);
+}
+
+// Serve one connection; the client's handle is released when it disconnects
+static void serveClient(int fd) {
+    SmartPredictor* handle = nullptr;
+    std::vector<char> result;
+    IpcRequest request;
+    int imageFd = -1;
+    while (ipcRecvRequest(fd, &request, &imageFd)) {
+        std::string text1;
+        std::string text2;
+        if (!recvText(fd, request.text1Length, &text1) || !recvText(fd, request.text2Length, &text2)) {
+            if (imageFd >= 0) {
+                close(imageFd);
+            }
+            break;
+        }
+        unsigned char* image = nullptr;
+        if (request.hasImage) {
+            image = mapImage(imageFd, request.byteSize);
+        }
+        if (imageFd >= 0) {
+            close(imageFd);
+        }
+
+        int code = IPC_ERROR;
+        uint32_t payloadLength = 0;
+        switch (request.op) {
+            case IPC_LOAD:
+                predictorDestroy(handle);
+                handle = predictorCreate(text1.c_str(), request.pos);
+                code = handle ? 0 : -1;
+                break;
+            case IPC_UNLOAD:
+                predictorDestroy(handle);
+                handle = nullptr;
+                code = 0;
+                break;
+            case IPC_PREDICT:
+                if (handle && image && request.resultSize > 0) {
+                    result.assign(static_cast<size_t>(std::min(request.resultSize, IPC_MAX_RESULT)), '\0');
+                    code = predictorPredict(handle, image, request.byteSize, request.filterSim,
+                                            result.data(), static_cast<long>(result.size()));
+                    result.back() = '\0';
+                    payloadLength = static_cast<uint32_t>(std::strlen(result.data()) + 1);
+                }
+                break;
+            case IPC_REGIST:
+                if (handle && image) {
+                    code = predictorRegist(handle, image, request.byteSize, text1.c_str(), request.pos);
+                }
+                break;
+            case IPC_SAVE:
+                if (handle && (text1.empty() || text1 == handle->modelDir)) {
+                    code = predictorSave(handle);
+                } else if (handle) {
+                    code = predictorSaveCopy(handle, text1.c_str());
+                }
+                break;
+            case IPC_RESET:
+                // Like the other mutating ops, a reset needs a session
+                if (handle) {
+                    code = predictorReset(text1.c_str()) ? 1 : 0;
+                }
+                break;
+            case IPC_DELETE:
+                code = predictorDelete(handle, text1.c_str()) ? 1 : 0;
+                break;
+            case IPC_SIGN: {
+                std::lock_guard<std::mutex> lock(sdk_mutex);
+                code = sign_func(text1.c_str(), text2.c_str());
+                break;
+            }
+            default:
+                break;
+        }
+        if (image) {
+            munmap(image, static_cast<size_t>(request.byteSize));
+        }
+        if (!sendResponse(fd, code, result.data(), payloadLength)) {
+            break;
+        }
+    }
+    predictorDestroy(handle);
+    std::lock_guard<std::mutex> lock(client_mutex);
+    finished_clients.push_back(fd);
+}
+
+// Join threads of clients that have disconnected
+static void reapClients() {
+    std::vector<std::thread> done;
+    std::vector<int> closed;
+    {
+        std::lock_guard<std::mutex> lock(client_mutex);
+        for (size_t i = 0; i < finished_clients.size(); ++i) {
+            std::map<int, std::thread>::iterator it = client_threads.find(finished_clients[i]);
+            if (it != client_threads.end()) {
+                done.push_back(std::move(it->second));
+                closed.push_back(it->first);
+                client_threads.erase(it);
+            }
+        }
+        finished_clients.clear();
+    }
+    for (size_t i = 0; i < done.size(); ++i) {
+        done[i].join();
+    }
+    for (size_t i = 0; i < closed.size(); ++i) {
+        close(closed[i]);
+    }
+}
+
+int runDaemon(const char* socketPath, const char* modelDir, int modelType) {
+    // Clients resolve their model directory the same way, so both ends name it identically
+    char resolved[PATH_MAX];
+    if (!realpath(modelDir, resolved)) {
+        std::cerr << "Model directory not found: " << modelDir << std::endl;
+        return -1;
+    }
+    SmartPredictor* owner = predictorCreate(resolved, modelType);
+    if (!owner) {
+        std::cerr << "Failed to load model" << std::endl;
+        return -1;
+    }
+    predictorSetAutosave(AUTOSAVE_INTERVAL_SECONDS, AUTOSAVE_REGISTS);
+
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (std::strlen(socketPath) >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        predictorDestroy(owner);
+        return -1;
+    }
+    std::strcpy(addr.sun_path, socketPath);
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(socketPath);
+    // Any peer could reset or overwrite the gallery, so only the daemon's user and group may connect;
+    // the mode is set before listen(), so nobody connects in between
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        chmod(socketPath, SOCKET_MODE) != 0 || listen(listenFd, 16) != 0) {
+        std::cerr << "Failed to listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+        predictorDestroy(owner);
+        return -1;
+    }
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = onDaemonSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::cout << "Serving " << resolved << " on " << socketPath << std::endl;
+    while (!daemon_stop) {
+        struct pollfd pfd;
+        pfd.fd = listenFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 500) > 0) {
+            int clientFd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (clientFd >= 0) {
+                std::lock_guard<std::mutex> lock(client_mutex);
+                if (client_threads.size() >= static_cast<size_t>(DAEMON_MAX_CLIENTS)) {
+                    std::cerr << "Refusing connection: " << DAEMON_MAX_CLIENTS << " clients connected" << std::endl;
+                    close(clientFd);
+                } else {
+                    client_threads[clientFd] = std::thread(serveClient, clientFd);
+                }
+            }
+        }
+        reapClients();
+    }
+
+    std::cout << "Shutting down daemon..." << std::endl;
+    close(listenFd);
+    unlink(socketPath);
+    {
+        // Wake clients blocked on a read; their threads then release their handles
+        std::lock_guard<std::mutex> lock(client_mutex);
+        for (std::map<int, std::thread>::iterator it = client_threads.begin(); it != client_threads.end(); ++it) {
+            shutdown(it->first, SHUT_RDWR);
+        }
+    }
+    for (;;) {
+        reapClients();
+        {
+            std::lock_guard<std::mutex> lock(client_mutex);
+            if (client_threads.empty()) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    predictorSaveShutdown();
+    predictorDestroy(owner);
+    return 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file predictor_ipc.cpp
+ * @brief Socket framing shared by the predictor daemon and its client library
+ */
+
+#include "predictor_ipc.h"
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+
+bool ipcSendAll(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool ipcRecvAll(int fd, void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        bytes += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+bool ipcSendRequest(int fd, const IpcRequest& request, int imageFd) {
+    struct iovec iov;
+    iov.iov_base = const_cast<IpcRequest*>(&request);
+    iov.iov_len = sizeof(request);
+    char control[CMSG_SPACE(sizeof(int))];
+    std::memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (imageFd >= 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &imageFd, sizeof(int));
+    }
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent <= 0) {
+        return false;
+    }
+    // The descriptor went with the first byte; finish the header if the send was short
+    return ipcSendAll(fd, reinterpret_cast<const char*>(&request) + sent, sizeof(request) - static_cast<size_t>(sent));
+}
+
+bool ipcRecvRequest(int fd, IpcRequest* request, int* imageFd) {
+    *imageFd = -1;
+    struct iovec iov;
+    iov.iov_base = request;
+    iov.iov_len = sizeof(*request);
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t received;
+    do {
+        received = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return false;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            std::memcpy(imageFd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    if (!ipcRecvAll(fd, reinterpret_cast<char*>(request) + received, sizeof(*request) - static_cast<size_t>(received))) {
+        if (*imageFd >= 0) {
+            close(*imageFd);
+            *imageFd = -1;
+        }
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file predictor_ipc.h
+ * @brief Wire protocol between the predictor daemon and libsmart_predictor_client.so
+ *
+ * Each call is one IpcRequest followed by its text arguments, answered by one
+ * IpcResponse followed by its payload. Images do not travel over the socket:
+ * the client writes them into a memfd and passes the descriptor with
+ * SCM_RIGHTS alongside the request, and the daemon maps it.
+ */
+
+#ifndef PREDICTOR_IPC_H
+#define PREDICTOR_IPC_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Configuration parameters
+const char* const DAEMON_SOCKET_PATH = "/tmp/smart_predictor.sock";  // Default socket, overridden by SMART_PREDICTOR_SOCKET
+const unsigned SOCKET_MODE = 0660;  // Socket permissions: the daemon's user and group may connect
+const uint32_t IPC_MAX_TEXT = 4096;  // Longest label, path or authorization code accepted
+const int64_t IPC_MAX_RESULT = 1024 * 1024;  // Largest prediction buffer the daemon will fill
+const int DAEMON_MAX_CLIENTS = 64;  // Connections served at once; further ones are closed on accept
+const int IPC_ERROR = -2000;  // Result reported when the daemon could not be reached or rejected the request
+
+enum IpcOp {
+    IPC_LOAD = 1,
+    IPC_UNLOAD,
+    IPC_PREDICT,
+    IPC_REGIST,
+    IPC_SAVE,
+    IPC_RESET,
+    IPC_DELETE,
+    IPC_SIGN
+};
+
+struct IpcRequest {
+    uint32_t op;
+    int32_t pos;           // Registration position, or model type for IPC_LOAD
+    float filterSim;
+    uint32_t text1Length;  // Label, or model directory
+    uint32_t text2Length;  // Authorization code for IPC_SIGN
+    uint32_t hasImage;     // A memfd holding byteSize image bytes is attached
+    int64_t byteSize;
+    int64_t resultSize;    // Capacity of the caller's prediction buffer
+};
+
+struct IpcResponse {
+    int32_t result;
+    uint32_t payloadLength;  // Prediction text that follows, including the terminating NUL
+};
+
+// Framing helpers shared by both ends; all return false once the peer is gone
+bool ipcSendAll(int fd, const void* data, size_t size);
+bool ipcRecvAll(int fd, void* data, size_t size);
+bool ipcSendRequest(int fd, const IpcRequest& request, int imageFd);
+bool ipcRecvRequest(int fd, IpcRequest* request, int* imageFd);
+
+/**
+ * Serve the loaded model on a Unix domain socket until SIGINT or SIGTERM.
+ * The daemon keeps its own handle open so clients connecting and leaving
+ * never unload the model. The socket is created with SOCKET_MODE; add the
+ * client applications' users to the daemon's group.
+ * @return 0 on a clean shutdown, -1 if the socket could not be set up
+ */
+int runDaemon(const char* socketPath, const char* modelDir, int modelType);
+
+#endif // PREDICTOR_IPC_H
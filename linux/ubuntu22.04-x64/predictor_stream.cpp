@@ -0,0 +1,122 @@
+/**
+ * @file predictor_stream.cpp
+ * @brief Camera stream sessions that only predict when the scene changes (Linux version)
+ */
+
+#include "predictor_stream.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+// Mean absolute difference of two grids; grids of different size always differ
+static int gridDistance(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b) {
+    if (a.empty() || a.size() != b.size()) {
+        return 256;
+    }
+    long total = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        total += std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i]));
+    }
+    return static_cast<int>(total / static_cast<long>(a.size()));
+}
+
+static void copyResult(const std::string& text, char* result, long resultSize) {
+    if (resultSize <= 0) {
+        return;
+    }
+    size_t length = std::min(text.size(), static_cast<size_t>(resultSize - 1));
+    std::memcpy(result, text.data(), length);
+    result[length] = '\0';
+}
+
+PredictorStream* streamCreate(SmartPredictor* handle, float filterSim, const PrepOptions* prep, bool gate) {
+    if (!handle) {
+        return nullptr;
+    }
+    PredictorStream* stream = new PredictorStream();
+    stream->handle = handle;
+    stream->filterSim = filterSim;
+    stream->usePrep = prep != nullptr;
+    stream->gate = gate;
+    if (prep) {
+        stream->prep = *prep;
+    } else {
+        stream->prep.minSide = PREP_MIN_SIDE;
+        stream->prep.roi = PrepRegion{ 0, 0, 0, 0 };
+        stream->prep.quality = PREP_QUALITY;
+    }
+    stream->stableFrames = 0;
+    stream->hasResult = false;
+    stream->resultCode = 0;
+    stream->stats = StreamStats{ 0, 0, 0, 0 };
+    return stream;
+}
+
+void streamDestroy(PredictorStream* stream) {
+    delete stream;
+}
+
+void streamReset(PredictorStream* stream) {
+    stream->hasResult = false;
+    stream->scene.clear();
+    stream->stableFrames = 0;
+}
+
+int streamFeed(PredictorStream* stream, unsigned char* imgBytes, long byteSize, char* result, long resultSize,
+               StreamState* state) {
+    ++stream->stats.frames;
+    std::vector<unsigned char> grid;
+    bool watched = stream->gate && jpegThumbnail(imgBytes, byteSize, stream->prep.roi, STREAM_GRID, &grid);
+
+    if (watched) {
+        if (gridDistance(grid, stream->previous) > STREAM_CHANGE_THRESHOLD) {
+            stream->stableFrames = 0;
+        } else {
+            ++stream->stableFrames;
+        }
+        stream->previous.swap(grid);
+
+        // Still the scene of the cached result, e.g. a hand passed over the tray
+        if (stream->hasResult && gridDistance(stream->previous, stream->scene) <= STREAM_CHANGE_THRESHOLD) {
+            ++stream->stats.cached;
+            if (state) {
+                *state = STREAM_CACHED;
+            }
+            copyResult(stream->result, result, resultSize);
+            return stream->resultCode;
+        }
+        if (stream->stableFrames < STREAM_SETTLE_FRAMES) {
+            ++stream->stats.settling;
+            if (state) {
+                *state = STREAM_SETTLING;
+            }
+            copyResult("", result, resultSize);
+            return STREAM_UNSETTLED;
+        }
+    }
+
+    // Settled on a new scene, or a frame that cannot be watched: predict
+    std::vector<unsigned char> prepared;
+    PrepInfo info;
+    unsigned char* bytes = imgBytes;
+    long size = byteSize;
+    if (stream->usePrep && prepareJpeg(imgBytes, byteSize, stream->prep, &prepared, &info) == 0) {
+        bytes = prepared.data();
+        size = static_cast<long>(prepared.size());
+    }
+    int code = predictorPredict(stream->handle, bytes, size, stream->filterSim, result, resultSize);
+    ++stream->stats.predictions;
+    if (state) {
+        *state = STREAM_PREDICTED;
+    }
+    if (watched && code >= 0) {
+        stream->hasResult = true;
+        stream->resultCode = code;
+        stream->result = resultSize > 0 ? std::string(result) : std::string();
+        stream->scene = stream->previous;
+    } else {
+        stream->hasResult = false;
+    }
+    return code;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file predictor_stream.h
+ * @brief Camera stream sessions that only predict when the scene changes (Linux version)
+ *
+ * Integrators that poll the camera feed every frame into streamFeed(). With
+ * gating on, each frame is reduced to a coarse luma grid with
+ * jpegThumbnail(); a full prediction runs only after the grid has changed
+ * and then held still for STREAM_SETTLE_FRAMES frames. Until the scene
+ * changes again the cached result of that prediction is returned without
+ * calling the SDK. The gate costs a thumbnail decode per frame and only
+ * pays off when a prediction costs clearly more than that, so it is off
+ * unless requested; check the stream section of bench first. Without the
+ * gate every frame is predicted.
+ * Link with jpeg_prep.cpp and -ljpeg.
+ */
+
+#ifndef PREDICTOR_STREAM_H
+#define PREDICTOR_STREAM_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "smart_predictor.h"
+#include "jpeg_prep.h"
+
+// Configuration parameters
+const int STREAM_GRID = 16;  // Cells per side of the change-detection grid
+const int STREAM_CHANGE_THRESHOLD = 6;  // Mean absolute luma difference per cell (0-255) that counts as a change
+const int STREAM_SETTLE_FRAMES = 3;  // Consecutive unchanged frames before the scene counts as settled
+const int STREAM_UNSETTLED = -1001;  // Result of streamFeed while the scene is still moving
+
+// What streamFeed did with a frame
+enum StreamState {
+    STREAM_PREDICTED,  // Ran a full prediction on this frame
+    STREAM_CACHED,     // Returned the result of the last prediction
+    STREAM_SETTLING    // Scene changed recently; no result yet
+};
+
+// Frame counters of one stream
+struct StreamStats {
+    uint64_t frames;
+    uint64_t predictions;
+    uint64_t cached;
+    uint64_t settling;
+};
+
+/**
+ * One camera feed. Not shared between threads; predictions still go
+ * through predictorPredict(), so several streams can run side by side.
+ */
+struct PredictorStream {
+    SmartPredictor* handle;
+    float filterSim;
+    PrepOptions prep;
+    bool usePrep;                         // Predict on prepareJpeg() output cropped to prep.roi
+    bool gate;                            // Skip predictions while the scene is unchanged or moving
+    std::vector<unsigned char> previous;  // Grid of the last frame
+    std::vector<unsigned char> scene;     // Grid of the frame the cached result belongs to
+    int stableFrames;
+    bool hasResult;
+    int resultCode;
+    std::string result;
+    StreamStats stats;
+};
+
+/**
+ * Start a stream. With prep the frames are shrunk and cropped before
+ * prediction, and only the region of interest is watched for changes;
+ * pass nullptr to predict on the frames as delivered. Without gate every
+ * frame is predicted.
+ */
+PredictorStream* streamCreate(SmartPredictor* handle, float filterSim, const PrepOptions* prep, bool gate);
+void streamDestroy(PredictorStream* stream);
+
+/**
+ * Feed one frame.
+ * @return the prediction result as from predictorPredict (fresh or cached),
+ *         or STREAM_UNSETTLED with an empty result while the scene settles
+ */
+int streamFeed(PredictorStream* stream, unsigned char* imgBytes, long byteSize, char* result, long resultSize,
+               StreamState* state);
+
+// Drop the cached result, e.g. after the item on the scale was registered
+void streamReset(PredictorStream* stream);
+
+#endif // PREDICTOR_STREAM_H
@@ -0,0 +1,397 @@
+/**
+ * @file replay.cpp
+ * @brief Drive the SDK with a recorded or synthetic day of checkout traffic (Linux version)
+ * @note Build: g++ -std=c++11 replay.cpp smart_predictor.cpp -o replay -ldl -pthread
+ *
+ * Usage: ./replay <event_log> [--speed X] [--window-seconds S] [--top-k K] [--model DIR]
+ *        ./replay --synthesize <image_dir> [--events N] [--checkouts-per-minute R] [--seed N] > event_log
+ *
+ * An event log has one event per line, "timestamp_ms,op,image_path,label,pos",
+ * with op one of predict, regist, save or delete; lines starting with '#' are
+ * ignored. The label of a predict is the true label, used for accuracy. A
+ * regist with pos 0 takes the rank of its label in the preceding predict
+ * (capped at REGIST_MAX_POS), the index the cashier would have selected. A
+ * label the predict did not offer is registered with REGIST_MAX_POS, as the
+ * SDK documents for a manual pick, and counted as unranked.
+ *
+ * Events are replayed at their recorded spacing divided by --speed; 0 runs
+ * them back to back. The model directory is copied to a scratch directory
+ * first, with the entry store enabled so gallery growth can be counted.
+ * Per-window latency, gallery growth, memory and rolling accuracy are
+ * written to stdout as JSON. SMART_PREDICTOR_MODEL_TYPE selects the model
+ * variant.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <dlfcn.h>
+
+#include "smart_predictor.h"
+
+// Configuration parameters
+const char* DEFAULT_MODEL_DIR = "./model";
+const int MODEL_TYPE = modelTypeFromEnv();  // model_type of SmartPredictor_load, see modelTypeFromEnv()
+float PREDICTION_THRESHOLD = 0.3f;
+const int REGIST_MAX_POS = 6;  // Candidates the POS screen offers, see the sequence diagram in windows/docs
+const double SYNTH_CONFIRM_RATE = 0.7;  // Share of synthetic checkouts the cashier confirms with a regist
+const int SYNTH_SAVE_MINUTES = 10;  // Periodic save interval of the synthetic log
+const double SYNTH_DELETE_RATE = 0.001;  // Chance per synthetic checkout of deleting a label
+
+// One line of the event log
+struct ReplayEvent {
+    long long timestampMs;
+    std::string op;
+    std::string imagePath;
+    std::string label;
+    int pos;
+};
+
+// Measurements of one window of log time
+struct ReplayWindow {
+    std::map<std::string, std::vector<double> > latenciesMs;  // Op -> latencies
+    std::map<std::string, int> errors;
+    int scored;  // Predicts with a true label
+    int top1;
+    int topK;
+    int unranked;  // Regists with pos 0 whose label the preceding predict did not offer, included in the regist ops
+};
+
+long baseline_entries = 0;  // Tracked entries of the scratch copy before the first event
+long baseline_labels = 0;
+
+// Function declarations
+std::vector<ReplayEvent> readEventLog(const std::string& path);
+int synthesize(const std::string& imageDir, int events, double checkoutsPerMinute, unsigned seed);
+void printWindow(long long startMs, const ReplayWindow& window, int topK, bool last);
+void galleryCounts(long* entries, long* labels);
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <event_log> [--speed X] [--window-seconds S] [--top-k K] [--model DIR]" << std::endl;
+        std::cerr << "       " << argv[0]
+                  << " --synthesize <image_dir> [--events N] [--checkouts-per-minute R] [--seed N]" << std::endl;
+        return -1;
+    }
+    std::string source = argv[1];
+    bool synthesizeLog = source == "--synthesize";
+    int firstOption = 2;
+    if (synthesizeLog) {
+        if (argc < 3) {
+            std::cerr << "--synthesize needs an image directory" << std::endl;
+            return -1;
+        }
+        source = argv[2];
+        firstOption = 3;
+    }
+    std::string modelDir = DEFAULT_MODEL_DIR;
+    double speed = 1.0;
+    int windowSeconds = 600;
+    int topK = REGIST_MAX_POS;
+    int events = 1000;
+    double checkoutsPerMinute = 2.0;
+    unsigned seed = 1;
+    for (int i = firstOption; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--speed") {
+            speed = std::max(0.0, std::atof(argv[i + 1]));
+        } else if (option == "--window-seconds") {
+            windowSeconds = std::max(1, std::atoi(argv[i + 1]));
+        } else if (option == "--top-k") {
+            topK = std::max(1, std::atoi(argv[i + 1]));
+        } else if (option == "--model") {
+            modelDir = argv[i + 1];
+        } else if (option == "--events") {
+            events = std::max(1, std::atoi(argv[i + 1]));
+        } else if (option == "--checkouts-per-minute") {
+            checkoutsPerMinute = std::max(0.01, std::atof(argv[i + 1]));
+        } else if (option == "--seed") {
+            seed = static_cast<unsigned>(std::atoi(argv[i + 1]));
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return -1;
+        }
+    }
+    if (synthesizeLog) {
+        return synthesize(source, events, checkoutsPerMinute, seed);
+    }
+
+    std::vector<ReplayEvent> log;
+    try {
+        log = readEventLog(source);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+    if (log.empty()) {
+        std::cerr << "No events in " << source << std::endl;
+        return -1;
+    }
+
+    // Images are read up front so file I/O does not show up in the latencies
+    std::map<std::string, std::vector<unsigned char> > images;
+    for (size_t i = 0; i < log.size(); ++i) {
+        if (!log[i].imagePath.empty() && images.find(log[i].imagePath) == images.end()) {
+            try {
+                images[log[i].imagePath] = readImage(log[i].imagePath);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return -1;
+            }
+        }
+    }
+
+    if (!loadLibrary()) {
+        std::cerr << "Failed to load library: " << dlerror() << std::endl;
+        return -1;
+    }
+    if (!getFunctionPointers()) {
+        std::cerr << "Failed to get all required function pointers" << std::endl;
+        return -1;
+    }
+    char scratch[] = "/tmp/rx_replay_XXXXXX";
+    if (!mkdtemp(scratch) || !copyDirectory(modelDir, scratch)) {
+        std::cerr << "Failed to copy " << modelDir << " to a scratch directory" << std::endl;
+        return -1;
+    }
+    if (!predictorEnableEntryStore(scratch)) {
+        std::cerr << "Failed to enable the entry store" << std::endl;
+        removeDirectory(scratch);
+        return -1;
+    }
+    SmartPredictor* handle = predictorCreate(scratch, MODEL_TYPE);
+    if (!handle) {
+        std::cerr << "Failed to load model" << std::endl;
+        removeDirectory(scratch);
+        return -1;
+    }
+    galleryCounts(&baseline_entries, &baseline_labels);
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"events\": " << log.size() << "," << std::endl;
+    std::cout << "  \"speed\": " << speed << "," << std::endl;
+    std::cout << "  \"window_seconds\": " << windowSeconds << "," << std::endl;
+    std::cout << "  \"windows\": [" << std::endl;
+
+    long long firstMs = log[0].timestampMs;
+    long long windowMs = static_cast<long long>(windowSeconds) * 1000;
+    long long windowStart = firstMs;
+    ReplayWindow window = ReplayWindow();
+    ReplayWindow total = ReplayWindow();
+    std::vector<std::string> lastCandidates;  // Candidate labels of the last predict, best first
+    auto replayStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < log.size(); ++i) {
+        const ReplayEvent& event = log[i];
+        while (event.timestampMs >= windowStart + windowMs) {
+            printWindow(windowStart - firstMs, window, topK, false);
+            window = ReplayWindow();
+            windowStart += windowMs;
+        }
+        if (speed > 0) {
+            std::this_thread::sleep_until(replayStart + std::chrono::microseconds(
+                static_cast<long long>((event.timestampMs - firstMs) * 1000.0 / speed)));
+        }
+
+        std::vector<unsigned char>* image = event.imagePath.empty() ? nullptr : &images[event.imagePath];
+        bool ok = false;
+        bool unranked = false;
+        auto start = std::chrono::steady_clock::now();
+        if (event.op == "predict" && image) {
+            PredictScore scores[MAX_SCORES];
+            int scoreCount = 0;
+            ok = predictScores(handle, image->data(), static_cast<long>(image->size()), PREDICTION_THRESHOLD,
+                               scores, MAX_SCORES, &scoreCount) >= 0;
+            std::stable_sort(scores, scores + scoreCount,
+                             [](const PredictScore& a, const PredictScore& b) { return a.score > b.score; });
+            lastCandidates.clear();
+            for (int s = 0; s < scoreCount; ++s) {
+                lastCandidates.push_back(labelName(scores[s].labelId));
+            }
+        } else if (event.op == "regist" && image) {
+            int pos = event.pos;
+            if (pos == 0) {
+                std::vector<std::string>::iterator rank =
+                    std::find(lastCandidates.begin(), lastCandidates.end(), event.label);
+                unranked = rank == lastCandidates.end();
+                pos = unranked ? REGIST_MAX_POS
+                               : std::min(REGIST_MAX_POS, static_cast<int>(rank - lastCandidates.begin()) + 1);
+            }
+            ok = predictorRegist(handle, image->data(), static_cast<long>(image->size()),
+                                 event.label.c_str(), pos) >= 0;
+        } else if (event.op == "save") {
+            ok = predictorSave(handle) >= 0;
+        } else if (event.op == "delete") {
+            ok = predictorDelete(handle, event.label.c_str());
+        }
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        ReplayWindow* targets[] = { &window, &total };
+        for (int t = 0; t < 2; ++t) {
+            targets[t]->unranked += unranked ? 1 : 0;
+            if (ok) {
+                targets[t]->latenciesMs[event.op].push_back(ms);
+            } else {
+                ++targets[t]->errors[event.op];
+            }
+            if (event.op == "predict" && ok && !event.label.empty()) {
+                std::vector<std::string>::iterator rank =
+                    std::find(lastCandidates.begin(), lastCandidates.end(), event.label);
+                ++targets[t]->scored;
+                targets[t]->top1 += rank == lastCandidates.begin() && rank != lastCandidates.end() ? 1 : 0;
+                targets[t]->topK += rank != lastCandidates.end() && rank - lastCandidates.begin() < topK ? 1 : 0;
+            }
+        }
+    }
+    printWindow(windowStart - firstMs, window, topK, true);
+    std::cout << "  ]," << std::endl;
+    std::cout << "  \"total\": ";
+    printWindow(-1, total, topK, true);
+    std::cout << "}" << std::endl;
+
+    predictorSaveShutdown();
+    predictorDestroy(handle);
+    removeDirectory(scratch);
+    dlclose(lib_handle);
+    return 0;
+}
+
+std::vector<ReplayEvent> readEventLog(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open event log: " + path);
+    }
+    std::vector<ReplayEvent> log;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::stringstream fields(line);
+        std::string timestamp, pos;
+        ReplayEvent event;
+        std::getline(fields, timestamp, ',');
+        std::getline(fields, event.op, ',');
+        std::getline(fields, event.imagePath, ',');
+        std::getline(fields, event.label, ',');
+        std::getline(fields, pos, ',');
+        if (timestamp.empty() || (event.op != "predict" && event.op != "regist" && event.op != "save" &&
+                                  event.op != "delete")) {
+            throw std::runtime_error("Bad event on line " + std::to_string(lineNumber) + " of " + path);
+        }
+        event.timestampMs = std::atoll(timestamp.c_str());
+        event.pos = std::atoi(pos.c_str());
+        log.push_back(event);
+    }
+    std::stable_sort(log.begin(), log.end(), [](const ReplayEvent& a, const ReplayEvent& b) {
+        return a.timestampMs < b.timestampMs;
+    });
+    return log;
+}
+
+/**
+ * Write a synthetic event log for the images under imageDir/<label>/ to
+ * stdout: checkouts at a Poisson rate, each a predict of a random image that
+ * the cashier confirms with a regist most of the time, plus periodic saves
+ * and rare label deletes.
+ */
+int synthesize(const std::string& imageDir, int events, double checkoutsPerMinute, unsigned seed) {
+    std::vector<std::pair<std::string, std::string> > images;  // Path, label
+    if (!listLabelFiles(imageDir, &images)) {
+        std::cerr << "Failed to open image directory: " << imageDir << std::endl;
+        return -1;
+    }
+    if (images.empty()) {
+        std::cerr << "No images found in " << imageDir << std::endl;
+        return -1;
+    }
+
+    std::mt19937 random(seed);
+    std::exponential_distribution<double> gapMinutes(checkoutsPerMinute);
+    std::uniform_int_distribution<size_t> pick(0, images.size() - 1);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::cout << "# timestamp_ms,op,image_path,label,pos" << std::endl;
+    double nowMs = 0.0;
+    long long nextSaveMs = static_cast<long long>(SYNTH_SAVE_MINUTES) * 60000;
+    for (int written = 0; written < events;) {
+        nowMs += gapMinutes(random) * 60000.0;
+        while (nowMs >= nextSaveMs && written < events) {
+            std::cout << nextSaveMs << ",save,,," << std::endl;
+            nextSaveMs += static_cast<long long>(SYNTH_SAVE_MINUTES) * 60000;
+            ++written;
+        }
+        const std::pair<std::string, std::string>& image = images[pick(random)];
+        long long ms = static_cast<long long>(nowMs);
+        std::cout << ms << ",predict," << image.first << "," << image.second << "," << std::endl;
+        ++written;
+        if (written < events && chance(random) < SYNTH_CONFIRM_RATE) {
+            // The cashier takes a few seconds to pick the result
+            std::cout << ms + 2000 << ",regist," << image.first << "," << image.second << ",0" << std::endl;
+            ++written;
+        }
+        if (written < events && chance(random) < SYNTH_DELETE_RATE) {
+            std::cout << ms + 3000 << ",delete,," << images[pick(random)].second << "," << std::endl;
+            ++written;
+        }
+        // The next customer is served once this checkout is finished
+        nowMs += 3000.0;
+    }
+    return 0;
+}
+
+// Entries and labels the entry store tracks
+void galleryCounts(long* entries, long* labels) {
+    std::vector<LabelCount> counts;
+    predictorListLabels(&counts);
+    *entries = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        *entries += counts[i].samples;
+    }
+    *labels = static_cast<long>(counts.size());
+}
+
+/**
+ * One window as JSON, stamped with the gallery growth since the first event
+ * and the current memory; startMs < 0 omits the start. Growth is the net
+ * change in tracked entries and labels, so deletes of entries the model
+ * held before the replay make it negative.
+ */
+void printWindow(long long startMs, const ReplayWindow& window, int topK, bool last) {
+    long entries = 0;
+    long labels = 0;
+    galleryCounts(&entries, &labels);
+    std::cout << (startMs >= 0 ? "    {\"start_s\": " + std::to_string(startMs / 1000) + ", " : std::string("{"))
+              << "\"ops\": {";
+    const char* const ops[] = { "predict", "regist", "save", "delete" };
+    for (int o = 0; o < 4; ++o) {
+        std::map<std::string, std::vector<double> >::const_iterator it = window.latenciesMs.find(ops[o]);
+        std::vector<double> latencies = it != window.latenciesMs.end() ? it->second : std::vector<double>();
+        std::map<std::string, int>::const_iterator errors = window.errors.find(ops[o]);
+        std::cout << (o ? ", " : "") << "\"" << ops[o] << "\": {\"count\": " << latencies.size()
+                  << ", \"errors\": " << (errors != window.errors.end() ? errors->second : 0)
+                  << ", \"p50_ms\": " << percentile(latencies, 50)
+                  << ", \"p95_ms\": " << percentile(latencies, 95)
+                  << ", \"p99_ms\": " << percentile(latencies, 99)
+                  << ", \"max_ms\": " << (latencies.empty() ? 0.0 : *std::max_element(latencies.begin(), latencies.end()))
+                  << "}";
+    }
+    std::cout << "}, \"entries_added\": " << entries - baseline_entries
+              << ", \"labels_added\": " << labels - baseline_labels
+              << ", \"rss_kb\": " << memoryUsage().rssKb
+              << ", \"top1_accuracy\": " << (window.scored ? static_cast<double>(window.top1) / window.scored : 0.0)
+              << ", \"top" << topK << "_accuracy\": "
+              << (window.scored ? static_cast<double>(window.topK) / window.scored : 0.0)
+              << ", \"unranked_regists\": " << window.unranked
+              << "}" << (last ? "" : ",") << std::endl;
+}
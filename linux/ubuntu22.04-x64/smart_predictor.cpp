@@ -0,0 +1,2485 @@
+/**
+ * @file smart_predictor.cpp
+ * @brief Client layer over libsmart_predictor_jni.so shared by the Linux demo and tools
+ */
+
+#include "smart_predictor.h"
+
+#include <iostream>
+#include <chrono>
+#include <stdexcept>
+#include <fstream>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <climits>
+#include <deque>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <list>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <ftw.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+// Configuration parameters
+const char* LIB_NAME = "./lib/libsmart_predictor_jni.so";
+const char* JOURNAL_FILE = "regist.journal";  // Registration journal inside the model directory
+const char* ENTRIES_FILE = "gallery.entries";  // Images of every tracked gallery entry, used by predictorCompact
+const char* SAVE_MARKER_FILE = "save.marker";  // Generation of the last save, checked before the journal is replayed
+const uint32_t EXPORT_VERSION = 1;  // Format version written by predictorExportGallery
+
+// One decoded journal or entry store record; the image stays in the source buffer or file
+struct GalleryRecord {
+    char op;
+    int64_t timestamp;
+    int32_t pos;
+    std::string label;
+    uint64_t imageOffset;
+    uint32_t imageSize;
+};
+
+// Queued predictAsync request; owns a copy of the image bytes
+struct AsyncJob {
+    long requestId;
+    int lane;
+    SmartPredictor* handle;
+    std::vector<unsigned char> image;
+    float filterSim;
+    PredictCallback callback;
+    void* userData;
+};
+
+// Function pointers
+void* lib_handle = nullptr;
+SmartPredictor_load load_func = nullptr;
+SmartPredictor_unload unload_func = nullptr;
+SmartPredictor_predict_img predict_func = nullptr;
+SmartPredictor_regist_img regist_func = nullptr;
+SmartPredictor_save save_func = nullptr;
+SmartPredictor_reset reset_func = nullptr;
+SmartPredictor_delete delete_func = nullptr;
+SmartPredictor_sign sign_func = nullptr;
+static void (*omp_set_threads_func)(int) = nullptr;  // omp_set_num_threads, if the SDK links OpenMP
+
+// Stage counters behind predictorGetStats(); relaxed atomics keep them cheap enough to leave on
+struct StageCounters {
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> totalUs;
+    std::atomic<uint64_t> maxUs;
+    std::atomic<uint64_t> buckets[STAT_BUCKETS];
+};
+StageCounters stage_counters[STAT_STAGE_COUNT];
+std::atomic<uint64_t> bytes_loaded(0);
+std::atomic<uint64_t> bytes_saved(0);
+
+// Entry store; guarded by sdk_mutex
+int entries_fd = -1;
+uint64_t entries_bytes = 0;
+std::map<std::string, std::vector<GalleryRecord> > gallery_entries;  // Label -> tracked entries, oldest first
+std::map<std::string, int> label_caps;  // Per-label overrides of default_label_cap
+int default_label_cap = 0;  // 0 leaves labels uncapped
+std::map<std::string, std::set<uint64_t> > label_hashes;  // Image hashes of tracked entries, filled per label on demand
+bool store_covers_all = false;  // The store has a 'C' record: every label since then is tracked in full
+std::set<std::string> covered_labels;  // Labels with a 'D' record: the store holds all their entries
+
+// Label id -> label text, and its reverse index
+std::deque<std::string> label_table;
+std::map<std::string, int> label_ids;
+std::mutex label_mutex;
+
+// Shared model state behind the SmartPredictor handles
+std::mutex sdk_mutex;
+int sdk_refs = 0;
+std::string sdk_model_dir;
+
+// Registration journal, appended to between saves and replayed on load
+int journal_fd = -1;
+long journal_bytes = 0;
+int journal_replayed = 0;  // Records replayed by the last model load
+uint64_t save_generation = 0;  // Generation of the last completed save, as in SAVE_MARKER_FILE
+
+// Background saver thread and autosave policy
+std::mutex save_mutex;
+std::condition_variable save_cv;
+std::thread save_thread;
+bool save_requested = false;
+bool save_stop = false;
+SaveStatus save_status = { false, 0, 0, 0 };
+int autosave_interval_seconds = 0;  // 0 disables the time trigger
+int autosave_regists = 0;  // 0 disables the count trigger
+std::chrono::steady_clock::time_point last_save_time = std::chrono::steady_clock::now();
+std::chrono::steady_clock::time_point autosave_retry_time;  // Autosave is held off until then
+
+// Images of recent predictions by token, most recent first
+std::mutex token_mutex;
+std::list<std::pair<long, std::vector<unsigned char> > > token_images;
+std::map<long, std::list<std::pair<long, std::vector<unsigned char> > >::iterator> token_index;
+long token_next = 1;
+
+// Async worker pool and completion queue
+std::mutex async_mutex;
+std::condition_variable async_cv;
+std::deque<AsyncJob> async_jobs;
+std::deque<PredictCompletion> async_done;
+std::map<int, long> async_latest;  // Lane -> newest request id
+std::vector<std::thread> async_workers;
+long async_next_id = 1;
+bool async_stop = false;
+int async_event_fd = -1;
+
+typedef std::chrono::steady_clock::time_point StageStart;
+
+static StageStart stageStart() {
+    return std::chrono::steady_clock::now();
+}
+
+static void recordStage(StatStage stage, StageStart start, bool ok) {
+    uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    StageCounters& counters = stage_counters[stage];
+    counters.calls.fetch_add(1, std::memory_order_relaxed);
+    if (!ok) {
+        counters.errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    counters.totalUs.fetch_add(us, std::memory_order_relaxed);
+    uint64_t max = counters.maxUs.load(std::memory_order_relaxed);
+    while (us > max && !counters.maxUs.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+    int bucket = 0;
+    while (bucket < STAT_BUCKETS - 1 && us >= (64ull << bucket)) {
+        ++bucket;
+    }
+    counters.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+bool loadLibrary() {
+    lib_handle = dlopen(LIB_NAME, RTLD_LAZY);
+    return lib_handle != nullptr;
+}
+
+bool getFunctionPointers() {
+    load_func = (SmartPredictor_load)dlsym(lib_handle, "SmartPredictor_load");
+    unload_func = (SmartPredictor_unload)dlsym(lib_handle, "SmartPredictor_unload");
+    predict_func = (SmartPredictor_predict_img)dlsym(lib_handle, "SmartPredictor_predict_img");
+    regist_func = (SmartPredictor_regist_img)dlsym(lib_handle, "SmartPredictor_regist_img");
+    save_func = (SmartPredictor_save)dlsym(lib_handle, "SmartPredictor_save");
+    reset_func = (SmartPredictor_reset)dlsym(lib_handle, "SmartPredictor_reset");
+    delete_func = (SmartPredictor_delete)dlsym(lib_handle, "SmartPredictor_delete");
+    sign_func = (SmartPredictor_sign)dlsym(lib_handle, "SmartPredictor_sign");
+    // Optional: present when the SDK's runtime is OpenMP
+    omp_set_threads_func = reinterpret_cast<void (*)(int)>(dlsym(lib_handle, "omp_set_num_threads"));
+
+    return load_func && unload_func && predict_func && regist_func && 
+           save_func && reset_func && sign_func && delete_func;
+}
+
+/*
+ * Registration journal. SmartPredictor_save rewrites the whole gallery, so
+ * every successful regist and delete is also appended to JOURNAL_FILE in
+ * the model directory. Loading the model replays the journal and a
+ * successful save truncates it, so registrations made since the last save
+ * survive a crash. Record layout (native byte order):
+ *   op (1) | timestamp ms (8) | pos (4) | label length (4) | label
+ *   | image length (4) | image | FNV-1a checksum of the preceding bytes (4)
+ * The journal starts with a 'G' record holding, in the timestamp field, the
+ * generation of the save it follows. Each save bumps the generation in
+ * SAVE_MARKER_FILE, marked pending before SmartPredictor_save and done after
+ * it, so a journal left behind by a crash between the save and its truncation
+ * is recognised as already saved and is not replayed twice.
+ * The journal is only touched with sdk_mutex held.
+ */
+const char JOURNAL_MAGIC[4] = { 'R', 'X', 'J', '1' };
+
+static uint32_t fnv1a(const char* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+// 64-bit variant used to recognise images already in the gallery
+static uint64_t fnv1a64(const unsigned char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+template <typename T>
+static void putValue(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool getValue(const std::string& in, size_t& offset, T* value) {
+    if (in.size() - offset < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(value, in.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+static std::string encodeRecord(char op, int64_t timestamp, const char* label, int pos,
+                                const unsigned char* imgBytes, long byteSize) {
+    uint32_t labelSize = static_cast<uint32_t>(std::strlen(label));
+    std::string record;
+    record.reserve(25 + labelSize + byteSize);
+    record += op;
+    putValue<int64_t>(record, timestamp);
+    putValue<int32_t>(record, pos);
+    putValue<uint32_t>(record, labelSize);
+    record.append(label, labelSize);
+    putValue<uint32_t>(record, static_cast<uint32_t>(byteSize));
+    record.append(reinterpret_cast<const char*>(imgBytes), static_cast<size_t>(byteSize));
+    putValue<uint32_t>(record, fnv1a(record.data(), record.size()));
+    return record;
+}
+
+static int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Append one record; without sync the caller makes it durable with journalSync()
+static void journalAppend(char op, int64_t timestamp, const char* label, int pos,
+                          const unsigned char* imgBytes, long byteSize, bool sync = true) {
+    if (journal_fd < 0) {
+        return;
+    }
+    std::string record = encodeRecord(op, timestamp, label, pos, imgBytes, byteSize);
+    StageStart start = stageStart();
+    if (write(journal_fd, record.data(), record.size()) != static_cast<ssize_t>(record.size()) ||
+        (sync && fdatasync(journal_fd) != 0)) {
+        recordStage(STAT_JOURNAL, start, false);
+        std::cerr << "Failed to append to registration journal" << std::endl;
+        return;
+    }
+    if (sync) {
+        recordStage(STAT_JOURNAL, start, true);
+    }
+    journal_bytes += static_cast<long>(record.size());
+}
+
+static void journalSync() {
+    if (journal_fd < 0) {
+        return;
+    }
+    StageStart start = stageStart();
+    bool synced = fdatasync(journal_fd) == 0;
+    recordStage(STAT_JOURNAL, start, synced);
+    if (!synced) {
+        std::cerr << "Failed to sync registration journal" << std::endl;
+    }
+}
+
+// Empty the journal, leaving the magic and the generation of the last save
+static void journalTruncate() {
+    if (journal_fd < 0) {
+        return;
+    }
+    std::string header(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    header += encodeRecord('G', static_cast<int64_t>(save_generation), "", 0, nullptr, 0);
+    // The journal is opened O_APPEND, so after truncating to 0 the header lands at the start
+    if (ftruncate(journal_fd, 0) != 0 ||
+        write(journal_fd, header.data(), header.size()) != static_cast<ssize_t>(header.size()) ||
+        fdatasync(journal_fd) != 0) {
+        std::cerr << "Failed to truncate registration journal" << std::endl;
+        return;
+    }
+    journal_bytes = static_cast<long>(header.size());
+}
+
+// Replace the save marker through a temporary file, so a crash leaves the old or the new one
+static bool writeSaveMarker(const std::string& modelDir, uint64_t generation, bool done) {
+    std::string path = modelDir + "/" + SAVE_MARKER_FILE;
+    std::string tmpPath = path + ".tmp";
+    std::string text = std::to_string(generation) + (done ? " done\n" : " pending\n");
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size()) && fdatasync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Read the save marker; false if there is none yet
+static bool readSaveMarker(const std::string& modelDir, uint64_t* generation, bool* done, int64_t* writtenNs) {
+    std::string path = modelDir + "/" + SAVE_MARKER_FILE;
+    std::ifstream file(path.c_str());
+    std::string state;
+    struct stat st;
+    if (!(file >> *generation >> state) || stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    *done = state == "done";
+    *writtenNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+// Files this layer keeps in the model directory next to the SDK's own
+static bool isLayerFile(const std::string& name) {
+    return name == JOURNAL_FILE || name == ENTRIES_FILE || name == SAVE_MARKER_FILE ||
+           name == std::string(ENTRIES_FILE) + ".tmp" || name == std::string(SAVE_MARKER_FILE) + ".tmp";
+}
+
+/**
+ * Add the size and newest modification time, in ns, of the regular files
+ * below dir; skipLayerFiles leaves out this layer's files to measure what
+ * the SDK wrote to a model directory.
+ * @return false if dir could not be read
+ */
+static bool fileStats(const std::string& dir, bool skipLayerFiles, long long* bytes, int64_t* newestNs) {
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) {
+        return false;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != nullptr) {
+        std::string name = entry->d_name;
+        struct stat st;
+        if (name == "." || name == ".." || (skipLayerFiles && isLayerFile(name)) ||
+            lstat((dir + "/" + name).c_str(), &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            fileStats(dir + "/" + name, false, bytes, newestNs);
+        } else if (S_ISREG(st.st_mode)) {
+            *bytes += st.st_size;
+            *newestNs = std::max(*newestNs, static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec);
+        }
+    }
+    closedir(handle);
+    return true;
+}
+
+static void entriesReconcile(const std::string& contents, const std::vector<GalleryRecord>& records);
+
+// Open the journal of modelDir and replay it into the freshly loaded model
+static void journalOpen(const std::string& modelDir) {
+    journal_replayed = 0;
+    uint64_t markerGeneration = 0;
+    bool markerDone = true;
+    int64_t markerNs = 0;
+    bool marker = readSaveMarker(modelDir, &markerGeneration, &markerDone, &markerNs);
+    save_generation = markerGeneration;
+    std::string path = modelDir + "/" + JOURNAL_FILE;
+    journal_fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (journal_fd < 0) {
+        std::cerr << "Failed to open registration journal: " << path << std::endl;
+        return;
+    }
+    std::string contents;
+    char chunk[65536];
+    ssize_t n;
+    while ((n = pread(journal_fd, chunk, sizeof(chunk), static_cast<off_t>(contents.size()))) > 0) {
+        contents.append(chunk, static_cast<size_t>(n));
+    }
+    if (contents.size() < sizeof(JOURNAL_MAGIC) ||
+        std::memcmp(contents.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0) {
+        if (marker && !markerDone) {
+            writeSaveMarker(modelDir, markerGeneration - 1, true);
+            save_generation = markerGeneration - 1;
+        }
+        journalTruncate();
+        return;
+    }
+
+    std::vector<GalleryRecord> records;
+    uint64_t journalGeneration = 0;
+    size_t offset = sizeof(JOURNAL_MAGIC);
+    for (;;) {
+        size_t start = offset;
+        char op;
+        int64_t timestamp;
+        int32_t pos;
+        uint32_t labelSize, imageSize, checksum;
+        if (!getValue(contents, offset, &op) || !getValue(contents, offset, &timestamp) ||
+            !getValue(contents, offset, &pos) || !getValue(contents, offset, &labelSize) ||
+            contents.size() - offset < labelSize) {
+            offset = start;
+            break;
+        }
+        std::string label = contents.substr(offset, labelSize);
+        offset += labelSize;
+        if (!getValue(contents, offset, &imageSize) || contents.size() - offset < imageSize) {
+            offset = start;
+            break;
+        }
+        size_t imageOffset = offset;
+        offset += imageSize;
+        if (!getValue(contents, offset, &checksum) ||
+            checksum != fnv1a(contents.data() + start, offset - start - sizeof(checksum))) {
+            offset = start;
+            break;
+        }
+        if (op == 'G') {
+            journalGeneration = static_cast<uint64_t>(timestamp);
+            continue;
+        }
+        GalleryRecord record;
+        record.op = op;
+        record.timestamp = timestamp;
+        record.pos = pos;
+        record.label = label;
+        record.imageOffset = imageOffset;
+        record.imageSize = imageSize;
+        records.push_back(record);
+    }
+
+    // A save newer than the journal already holds its records. A save that was
+    // still pending counts once the SDK has written files since it started.
+    bool saved = false;
+    if (marker && journalGeneration < markerGeneration) {
+        saved = markerDone;
+        if (!markerDone) {
+            long long bytes = 0;
+            int64_t newestNs = 0;
+            fileStats(modelDir, true, &bytes, &newestNs);
+            saved = newestNs >= markerNs;
+            save_generation = saved ? markerGeneration : markerGeneration - 1;
+            writeSaveMarker(modelDir, save_generation, true);
+        }
+    }
+    entriesReconcile(contents, records);
+    if (saved) {
+        journalTruncate();
+        return;
+    }
+    for (size_t i = 0; i < records.size(); ++i) {
+        unsigned char* image = reinterpret_cast<unsigned char*>(&contents[records[i].imageOffset]);
+        if (records[i].op == 'R') {
+            regist_func(image, records[i].imageSize, records[i].label.c_str(), records[i].pos);
+        } else if (records[i].op == 'D') {
+            delete_func(records[i].label.c_str());
+        }
+        ++journal_replayed;
+    }
+    // Drop a record torn by a crash so new records follow the last good one
+    if (offset < contents.size() && ftruncate(journal_fd, static_cast<off_t>(offset)) != 0) {
+        std::cerr << "Failed to repair registration journal" << std::endl;
+    }
+    journal_bytes = static_cast<long>(offset);
+    std::lock_guard<std::mutex> lock(save_mutex);
+    save_status.pendingRegists = journal_replayed;
+}
+
+static void journalClose() {
+    if (journal_fd >= 0) {
+        close(journal_fd);
+        journal_fd = -1;
+    }
+}
+
+/**
+ * Entry store. The SDK can only delete a label as a whole, so pruning a label
+ * means deleting it and registering the entries worth keeping again. Once
+ * predictorEnableEntryStore() has created ENTRIES_FILE in a model directory,
+ * every regist made through this layer is also appended to it with its image,
+ * in the journal's record layout, and a delete appends a 'D' record. Unlike
+ * the journal, a save does not truncate it; predictorCompact rewrites it.
+ * Changes go to the journal first and appends are synced only by saves;
+ * loading the model adds journal records the store is missing.
+ * Entries registered before the store existed, or by programs not using this
+ * layer, are not tracked. A label is therefore only known to be tracked in
+ * full after a 'D' record for it, or after a 'C' record, which a gallery
+ * reset writes; only such covered labels can be rebuilt.
+ */
+const char ENTRIES_MAGIC[4] = { 'R', 'X', 'E', '1' };
+
+// Read the header of the record at offset, leaving the image in the file
+static bool readRecordHeader(int fd, uint64_t offset, uint64_t fileSize, GalleryRecord* record, uint64_t* next) {
+    char fixed[17];
+    uint32_t labelSize, imageSize;
+    if (fileSize - offset < sizeof(fixed) ||
+        pread(fd, fixed, sizeof(fixed), static_cast<off_t>(offset)) != static_cast<ssize_t>(sizeof(fixed))) {
+        return false;
+    }
+    record->op = fixed[0];
+    std::memcpy(&record->timestamp, fixed + 1, sizeof(record->timestamp));
+    std::memcpy(&record->pos, fixed + 9, sizeof(record->pos));
+    std::memcpy(&labelSize, fixed + 13, sizeof(labelSize));
+    offset += sizeof(fixed);
+    if (fileSize - offset < labelSize + sizeof(imageSize)) {
+        return false;
+    }
+    record->label.assign(labelSize, '\0');
+    if ((labelSize > 0 && pread(fd, &record->label[0], labelSize, static_cast<off_t>(offset)) !=
+                              static_cast<ssize_t>(labelSize)) ||
+        pread(fd, &imageSize, sizeof(imageSize), static_cast<off_t>(offset + labelSize)) !=
+            static_cast<ssize_t>(sizeof(imageSize))) {
+        return false;
+    }
+    offset += labelSize + sizeof(imageSize);
+    if (fileSize - offset < imageSize + sizeof(uint32_t)) {
+        return false;
+    }
+    record->imageOffset = offset;
+    record->imageSize = imageSize;
+    *next = offset + imageSize + sizeof(uint32_t);
+    return true;
+}
+
+// Read the image of an indexed record, verifying the record checksum
+static bool readRecordImage(int fd, const GalleryRecord& record, std::vector<unsigned char>* image) {
+    uint64_t start = record.imageOffset - 21 - record.label.size();
+    std::string bytes(static_cast<size_t>(record.imageOffset + record.imageSize + sizeof(uint32_t) - start), '\0');
+    if (pread(fd, &bytes[0], bytes.size(), static_cast<off_t>(start)) != static_cast<ssize_t>(bytes.size())) {
+        return false;
+    }
+    uint32_t checksum;
+    std::memcpy(&checksum, bytes.data() + bytes.size() - sizeof(checksum), sizeof(checksum));
+    if (checksum != fnv1a(bytes.data(), bytes.size() - sizeof(checksum))) {
+        return false;
+    }
+    image->assign(bytes.begin() + static_cast<long>(record.imageOffset - start),
+                  bytes.end() - static_cast<long>(sizeof(checksum)));
+    return true;
+}
+
+// Apply one record to the in-memory index
+static void indexRecord(const GalleryRecord& record) {
+    if (record.op == 'R') {
+        gallery_entries[record.label].push_back(record);
+    } else if (record.op == 'D') {
+        gallery_entries.erase(record.label);
+        label_hashes.erase(record.label);
+        covered_labels.insert(record.label);
+    } else if (record.op == 'C') {
+        gallery_entries.clear();
+        label_hashes.clear();
+        covered_labels.clear();
+        store_covers_all = true;
+    }
+}
+
+// Whether the store holds every entry the SDK has for label; called with sdk_mutex held
+static bool labelCoveredLocked(const std::string& label) {
+    return store_covers_all || covered_labels.count(label) > 0;
+}
+
+// Magic of a new store, followed by a 'C' record when the gallery is known to be empty
+static std::string entriesHeader(bool coversAll) {
+    std::string header(ENTRIES_MAGIC, sizeof(ENTRIES_MAGIC));
+    if (coversAll) {
+        header += encodeRecord('C', nowMs(), "", 0, nullptr, 0);
+    }
+    return header;
+}
+
+// Empty the store open on fd, which is opened O_APPEND, and index its new header
+static bool entriesInitialise(int fd, bool coversAll) {
+    gallery_entries.clear();
+    label_hashes.clear();
+    covered_labels.clear();
+    store_covers_all = coversAll;
+    std::string header = entriesHeader(coversAll);
+    if (ftruncate(fd, 0) != 0 || write(fd, header.data(), header.size()) != static_cast<ssize_t>(header.size())) {
+        std::cerr << "Failed to initialise entry store" << std::endl;
+        return false;
+    }
+    entries_bytes = header.size();
+    return true;
+}
+
+// Open the entry store of modelDir, if it has one, and index it; only headers are read
+static void entriesOpen(const std::string& modelDir) {
+    gallery_entries.clear();
+    label_hashes.clear();
+    covered_labels.clear();
+    store_covers_all = false;
+    std::string path = modelDir + "/" + ENTRIES_FILE;
+    entries_fd = open(path.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+    if (entries_fd < 0) {
+        if (errno != ENOENT) {
+            std::cerr << "Failed to open entry store: " << path << std::endl;
+        }
+        return;
+    }
+    struct stat st;
+    char magic[sizeof(ENTRIES_MAGIC)];
+    if (fstat(entries_fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(magic)) ||
+        pread(entries_fd, magic, sizeof(magic), 0) != static_cast<ssize_t>(sizeof(magic)) ||
+        std::memcmp(magic, ENTRIES_MAGIC, sizeof(magic)) != 0) {
+        entriesInitialise(entries_fd, false);
+        return;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+    uint64_t offset = sizeof(ENTRIES_MAGIC);
+    GalleryRecord record;
+    uint64_t next;
+    while (readRecordHeader(entries_fd, offset, fileSize, &record, &next)) {
+        indexRecord(record);
+        offset = next;
+    }
+    // Drop a record torn by a crash so new records follow the last complete one
+    if (offset < fileSize && ftruncate(entries_fd, static_cast<off_t>(offset)) != 0) {
+        std::cerr << "Failed to repair entry store" << std::endl;
+    }
+    entries_bytes = offset;
+}
+
+static void entriesAppend(char op, int64_t timestamp, const char* label, int pos,
+                          const unsigned char* imgBytes, long byteSize) {
+    if (entries_fd < 0) {
+        return;
+    }
+    GalleryRecord record;
+    record.op = op;
+    record.timestamp = timestamp;
+    record.pos = pos;
+    record.label = label;
+    record.imageOffset = entries_bytes + 21 + record.label.size();
+    record.imageSize = static_cast<uint32_t>(byteSize);
+    std::string bytes = encodeRecord(op, record.timestamp, label, pos, imgBytes, byteSize);
+    if (write(entries_fd, bytes.data(), bytes.size()) != static_cast<ssize_t>(bytes.size())) {
+        std::cerr << "Failed to append to entry store" << std::endl;
+        return;
+    }
+    entries_bytes += bytes.size();
+    indexRecord(record);
+    std::map<std::string, std::set<uint64_t> >::iterator hashes = label_hashes.find(record.label);
+    if (op == 'R' && hashes != label_hashes.end()) {
+        hashes->second.insert(fnv1a64(imgBytes, static_cast<size_t>(byteSize)));
+    }
+}
+
+/**
+ * Add journal records the entry store missed to it. The store is appended
+ * after the journal and synced only by saves, so a crash can cut its tail
+ * short; records are matched by op, timestamp and label.
+ */
+static void entriesReconcile(const std::string& contents, const std::vector<GalleryRecord>& records) {
+    if (entries_fd < 0 || records.empty()) {
+        return;
+    }
+    int64_t since = records.front().timestamp;
+    for (size_t i = 1; i < records.size(); ++i) {
+        since = std::min(since, records[i].timestamp);
+    }
+    std::multiset<std::pair<int64_t, std::string> > stored;
+    uint64_t offset = sizeof(ENTRIES_MAGIC);
+    GalleryRecord record;
+    uint64_t next;
+    while (readRecordHeader(entries_fd, offset, entries_bytes, &record, &next)) {
+        if (record.timestamp >= since) {
+            stored.insert(std::make_pair(record.timestamp, std::string(1, record.op) + record.label));
+        }
+        offset = next;
+    }
+    for (size_t i = 0; i < records.size(); ++i) {
+        std::multiset<std::pair<int64_t, std::string> >::iterator match =
+            stored.find(std::make_pair(records[i].timestamp, std::string(1, records[i].op) + records[i].label));
+        if (match != stored.end()) {
+            stored.erase(match);
+            continue;
+        }
+        entriesAppend(records[i].op, records[i].timestamp, records[i].label.c_str(), records[i].pos,
+                      reinterpret_cast<const unsigned char*>(contents.data() + records[i].imageOffset),
+                      static_cast<long>(records[i].imageSize));
+    }
+}
+
+// Empty the store after a gallery reset; every label registered from now on is tracked in full
+static void entriesTruncate() {
+    if (entries_fd >= 0) {
+        entriesInitialise(entries_fd, true);
+    }
+}
+
+static void entriesClose() {
+    gallery_entries.clear();
+    label_hashes.clear();
+    covered_labels.clear();
+    store_covers_all = false;
+    if (entries_fd >= 0) {
+        close(entries_fd);
+        entries_fd = -1;
+    }
+}
+
+/*
+ * Inference threading. The SDK has no threading parameters, so its runtime
+ * is configured from outside: OpenMP/BLAS environment variables before the
+ * library is opened, omp_set_num_threads() when the library exposes it,
+ * and CPU affinity. SDK calls run with the calling thread pinned to the
+ * configured cores, so the pool the runtime spawns during its first call
+ * inherits the mask, and OMP_PLACES binds OpenMP workers as well. Threads
+ * of the application are never touched.
+ */
+static ThreadConfig thread_config = { 0, std::vector<int>(), SPIN_DEFAULT };
+static cpu_set_t thread_cpus;
+static bool threads_pinned = false;   // thread_config.cpus is non-empty
+
+// Applies thread_config around one SDK call; construct with sdk_mutex held
+class SdkThreadScope {
+public:
+    SdkThreadScope() : restore(false) {
+        if (thread_config.threads > 0 && omp_set_threads_func) {
+            omp_set_threads_func(thread_config.threads);  // Per calling thread in OpenMP
+        }
+        if (threads_pinned) {
+            restore = pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) == 0 &&
+                      pthread_setaffinity_np(pthread_self(), sizeof(thread_cpus), &thread_cpus) == 0;
+        }
+    }
+    ~SdkThreadScope() {
+        if (restore) {
+            pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+        }
+    }
+
+private:
+    bool restore;
+    cpu_set_t saved;
+};
+
+// Save with sdk_mutex held; a successful save makes the journal redundant
+static int saveLocked(const std::string& modelDir) {
+    if (!writeSaveMarker(modelDir, save_generation + 1, false)) {
+        std::cerr << "Failed to write save marker" << std::endl;
+    }
+    StageStart start = stageStart();
+    int result = save_func(modelDir.c_str());
+    recordStage(STAT_SAVE, start, result >= 0);
+    if (result < 0) {
+        writeSaveMarker(modelDir, save_generation, true);
+    } else {
+        long long bytes = 0;
+        int64_t newestNs = 0;
+        fileStats(modelDir, true, &bytes, &newestNs);
+        bytes_saved.fetch_add(static_cast<uint64_t>(bytes), std::memory_order_relaxed);
+        // The store must hold everything the journal did before the journal goes
+        if (entries_fd >= 0 && fdatasync(entries_fd) != 0) {
+            std::cerr << "Failed to sync entry store" << std::endl;
+        }
+        ++save_generation;
+        if (!writeSaveMarker(modelDir, save_generation, true)) {
+            std::cerr << "Failed to write save marker" << std::endl;
+        }
+        journalTruncate();
+        std::lock_guard<std::mutex> lock(save_mutex);
+        save_status.pendingRegists = 0;
+        last_save_time = std::chrono::steady_clock::now();
+    }
+    return result;
+}
+
+static void saverThread() {
+    std::unique_lock<std::mutex> lock(save_mutex);
+    while (!save_stop) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        bool autosaveDue = now >= autosave_retry_time && (
+            (autosave_regists > 0 && save_status.pendingRegists >= autosave_regists) ||
+            (autosave_interval_seconds > 0 && save_status.pendingRegists > 0 &&
+             now - last_save_time >= std::chrono::seconds(autosave_interval_seconds)));
+        bool due = save_requested || autosaveDue;
+        if (!due) {
+            save_cv.wait_for(lock, std::chrono::seconds(1));
+            continue;
+        }
+        save_requested = false;
+        save_status.running = true;
+        lock.unlock();
+        int result = -1;
+        {
+            std::lock_guard<std::mutex> sdkLock(sdk_mutex);
+            SdkThreadScope threads;
+            if (sdk_refs > 0) {
+                result = saveLocked(sdk_model_dir);
+            }
+        }
+        lock.lock();
+        save_status.lastResult = result;
+        ++save_status.completed;
+        save_status.running = save_requested;
+        if (result < 0) {
+            // Back off rather than spinning on a failing disk or an unloaded model
+            autosave_retry_time = std::chrono::steady_clock::now() + std::chrono::seconds(AUTOSAVE_RETRY_SECONDS);
+        }
+    }
+}
+
+// Start the saver thread on first use; called with save_mutex held
+static void startSaverLocked() {
+    if (!save_thread.joinable()) {
+        save_stop = false;
+        save_thread = std::thread(saverThread);
+    }
+}
+
+// Count a regist or delete towards the autosave policy; called with sdk_mutex held
+static void noteUnsavedChange() {
+    std::lock_guard<std::mutex> lock(save_mutex);
+    ++save_status.pendingRegists;
+    if ((autosave_regists > 0 && save_status.pendingRegists >= autosave_regists) ||
+        journal_bytes >= JOURNAL_COMPACT_BYTES) {
+        startSaverLocked();
+        save_requested = true;
+        save_status.running = true;
+        save_cv.notify_one();
+    }
+}
+
+/**
+ * Count changes that bypassed the journal and whose closing save failed, so
+ * autosave retries the save after the usual back-off; called with sdk_mutex held
+ */
+static void noteUnsavedBulk(long changes) {
+    std::lock_guard<std::mutex> lock(save_mutex);
+    save_status.pendingRegists += static_cast<int>(changes);
+    autosave_retry_time = std::chrono::steady_clock::now() + std::chrono::seconds(AUTOSAVE_RETRY_SECONDS);
+    save_cv.notify_one();
+}
+
+/**
+ * Configure the SDK's inference threads. Call before loadLibrary(), while
+ * the process has no other threads, for the environment variables (thread
+ * count for non-OpenMP runtimes, spin policy, OpenMP places) to take
+ * effect. Once the library is open the environment is left alone, since
+ * setenv() would race with getenv() on other threads; only the thread count
+ * with an OpenMP runtime can be changed then.
+ * @return false if a CPU is out of range, or if the library is already
+ *         open and part of the configuration needs a restart
+ */
+bool predictorConfigureThreads(const ThreadConfig& config) {
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    std::string places;
+    for (size_t i = 0; i < config.cpus.size(); ++i) {
+        if (config.cpus[i] < 0 || config.cpus[i] >= CPU_SETSIZE) {
+            return false;
+        }
+        CPU_SET(config.cpus[i], &cpus);
+        places += (i ? ",{" : "{") + std::to_string(config.cpus[i]) + "}";
+    }
+    bool cpusKept = threads_pinned == !config.cpus.empty() && (!threads_pinned || CPU_EQUAL(&cpus, &thread_cpus));
+    if (lib_handle) {
+        bool applied = config.spin == thread_config.spin && cpusKept &&
+                       (config.threads == thread_config.threads || omp_set_threads_func != nullptr);
+        if (applied) {
+            thread_config.threads = config.threads;
+        }
+        return applied;
+    }
+
+    if (config.threads > 0) {
+        std::string count = std::to_string(config.threads);
+        setenv("OMP_NUM_THREADS", count.c_str(), 1);
+        setenv("OPENBLAS_NUM_THREADS", count.c_str(), 1);
+        setenv("MKL_NUM_THREADS", count.c_str(), 1);
+    }
+    if (config.spin == SPIN_ACTIVE) {
+        setenv("OMP_WAIT_POLICY", "ACTIVE", 1);
+        setenv("KMP_BLOCKTIME", "infinite", 1);
+    } else if (config.spin == SPIN_PASSIVE) {
+        setenv("OMP_WAIT_POLICY", "PASSIVE", 1);
+        setenv("GOMP_SPINCOUNT", "0", 1);
+        setenv("KMP_BLOCKTIME", "0", 1);
+    }
+    if (!places.empty()) {
+        setenv("OMP_PLACES", places.c_str(), 1);
+        setenv("OMP_PROC_BIND", "true", 1);
+    }
+
+    thread_config = config;
+    thread_cpus = cpus;
+    threads_pinned = !config.cpus.empty();
+    return true;
+}
+
+ThreadConfig predictorThreadConfig() {
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    return thread_config;
+}
+
+/**
+ * Fill config from SMART_PREDICTOR_THREADS, SMART_PREDICTOR_CPUS (e.g.
+ * "2-3") and SMART_PREDICTOR_SPIN ("active" or "passive").
+ * @return true if any of them is set
+ */
+bool threadConfigFromEnv(ThreadConfig* config) {
+    config->threads = 0;
+    config->cpus.clear();
+    config->spin = SPIN_DEFAULT;
+    const char* threads = getenv("SMART_PREDICTOR_THREADS");
+    const char* cpus = getenv("SMART_PREDICTOR_CPUS");
+    const char* spin = getenv("SMART_PREDICTOR_SPIN");
+    if (threads) {
+        config->threads = std::max(0, std::atoi(threads));
+    }
+    if (cpus && !parseCpuList(cpus, &config->cpus)) {
+        std::cerr << "Ignoring SMART_PREDICTOR_CPUS=\"" << cpus << "\": not a CPU list; threads stay unpinned" << std::endl;
+    }
+    if (spin) {
+        std::string policy = spin;
+        config->spin = policy == "active" ? SPIN_ACTIVE : policy == "passive" ? SPIN_PASSIVE : SPIN_DEFAULT;
+    }
+    return threads || cpus || spin;
+}
+
+// Parse a model_type of SmartPredictor_load; false unless text is a whole number that fits an int
+bool parseModelType(const char* text, int* modelType) {
+    char* end = nullptr;
+    errno = 0;
+    long value = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || value < INT_MIN || value > INT_MAX) {
+        return false;
+    }
+    *modelType = static_cast<int>(value);
+    return true;
+}
+
+// Model variant from SMART_PREDICTOR_MODEL_TYPE, or DEFAULT_MODEL_TYPE when it is unset or not a number
+int modelTypeFromEnv() {
+    const char* modelType = getenv("SMART_PREDICTOR_MODEL_TYPE");
+    int value = DEFAULT_MODEL_TYPE;
+    return modelType && parseModelType(modelType, &value) ? value : DEFAULT_MODEL_TYPE;
+}
+
+/**
+ * Open a predictor session on modelDir. The model is loaded by the first
+ * session; later sessions must use the same directory and reuse it.
+ * @return the new handle, or nullptr if the model could not be loaded
+ */
+SmartPredictor* predictorCreate(const char* modelDir, int modelType) {
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    SdkThreadScope threads;
+    if (sdk_refs == 0) {
+        StageStart start = stageStart();
+        if (load_func(modelDir, modelType) < 0) {
+            recordStage(STAT_LOAD, start, false);
+            return nullptr;
+        }
+        sdk_model_dir = modelDir;
+        entriesOpen(sdk_model_dir);
+        journalOpen(sdk_model_dir);
+        recordStage(STAT_LOAD, start, true);
+        long long bytes = 0;
+        int64_t newestNs = 0;
+        fileStats(sdk_model_dir, true, &bytes, &newestNs);
+        bytes_loaded.fetch_add(static_cast<uint64_t>(bytes), std::memory_order_relaxed);
+    } else if (sdk_model_dir != modelDir) {
+        return nullptr;
+    }
+    ++sdk_refs;
+    SmartPredictor* handle = new SmartPredictor;
+    handle->modelDir = modelDir;
+    return handle;
+}
+
+void predictorDestroy(SmartPredictor* handle) {
+    if (!handle) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    SdkThreadScope threads;
+    if (--sdk_refs == 0) {
+        unload_func();
+        journalClose();
+        entriesClose();
+    }
+    delete handle;
+}
+
+int predictorPredict(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, float filterSim,
+                     char* result, long resultSize) {
+    if (!handle) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    SdkThreadScope threads;
+    StageStart start = stageStart();
+    int predictResult = predict_func(imgBytes, byteSize, filterSim, result, resultSize);
+    recordStage(STAT_PREDICT, start, predictResult >= 0);
+    return predictResult;
+}
+
+/**
+ * Predict into buffer, growing it and predicting again while the JSON
+ * fills it; the SDK does not report the size it needs.
+ * @return the SmartPredictor_predict_img result, or PREDICT_TRUNCATED if
+ *         the JSON does not fit in MAX_RESULT_BYTES
+ */
+static int predictGrowing(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, float filterSim,
+                          std::vector<char>* buffer) {
+    for (;;) {
+        (*buffer)[0] = '\0';
+        int result = predictorPredict(handle, imgBytes, byteSize, filterSim,
+                                      buffer->data(), static_cast<long>(buffer->size()));
+        if (result < 0 || std::strlen(buffer->data()) + 1 < buffer->size()) {
+            return result;
+        }
+        if (static_cast<long>(buffer->size()) >= MAX_RESULT_BYTES) {
+            return PREDICT_TRUNCATED;
+        }
+        buffer->resize(std::min(buffer->size() * 2, static_cast<size_t>(MAX_RESULT_BYTES)));
+    }
+}
+
+int predictorRegist(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, const char* label, int pos) {
+    if (!handle) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    SdkThreadScope threads;
+    StageStart start = stageStart();
+    int result = regist_func(imgBytes, byteSize, label, pos);
+    recordStage(STAT_REGIST, start, result >= 0);
+    if (result >= 0) {
+        int64_t now = nowMs();
+        journalAppend('R', now, label, pos, imgBytes, byteSize);
+        entriesAppend('R', now, label, pos, imgBytes, byteSize);
+        noteUnsavedChange();
+    }
+    return result;
+}
+
+int predictorSave(SmartPredictor* handle) {
+    if (!handle) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    SdkThreadScope threads;
+    return saveLocked(handle->modelDir);
+}
+
+// Save a copy of the gallery to modelDir; the journal and autosave state are left alone
+int predictorSaveCopy(SmartPredictor* handle, const char* modelDir) {
+    if (!handle) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    SdkThreadScope threads;
+    StageStart start = stageStart();
+    int result = save_func(modelDir);
+    recordStage(STAT_SAVE, start, result >= 0);
+    return result;
+}
+
+/**
+ * Queue a save on the background saver thread and return immediately.
+ * Progress is reported by predictorSaveStatus(). Predictions and
+ * registrations made while the gallery is written wait for the SDK
+ * save to finish, as with predictorSave().
+ */
+void predictorSaveAsync(SmartPredictor* handle) {
+    if (!handle) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(save_mutex);
+    startSaverLocked();
+    save_requested = true;
+    save_status.running = true;
+    save_cv.notify_one();
+}
+
+SaveStatus predictorSaveStatus() {
+    std::lock_guard<std::mutex> lock(save_mutex);
+    return save_status;
+}
+
+/**
+ * Save in the background once intervalSeconds have passed with unsaved
+ * registrations, or once registCount registrations are unsaved.
+ * Pass 0 to disable either trigger.
+ */
+void predictorSetAutosave(int intervalSeconds, int registCount) {
+    std::lock_guard<std::mutex> lock(save_mutex);
+    autosave_interval_seconds = intervalSeconds;
+    autosave_regists = registCount;
+    if (intervalSeconds > 0 || registCount > 0) {
+        startSaverLocked();
+    }
+    save_cv.notify_one();
+}
+
+// Stop the saver thread; a save that is being written completes first
+void predictorSaveShutdown() {
+    {
+        std::lock_guard<std::mutex> lock(save_mutex);
+        save_stop = true;
+    }
+    save_cv.notify_all();
+    if (save_thread.joinable()) {
+        save_thread.join();
+    }
+}
+
+/**
+ * Keep the entry store in modelDir from now on; predictorCompact,
+ * predictorRenameLabel and the gallery export and merge work from it. The
+ * store stays enabled for every later load of the directory. Labels that
+ * already had entries are only rebuilt once deleted, or after a reset.
+ * @return false if the store could not be created
+ */
+bool predictorEnableEntryStore(const char* modelDir) {
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    std::string path = std::string(modelDir) + "/" + ENTRIES_FILE;
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        std::string header = entriesHeader(false);
+        bool ok = write(fd, header.data(), header.size()) == static_cast<ssize_t>(header.size());
+        close(fd);
+        if (!ok) {
+            unlink(path.c_str());
+            return false;
+        }
+    } else if (errno != EEXIST) {
+        return false;
+    }
+    if (sdk_refs > 0 && sdk_model_dir == modelDir && entries_fd < 0) {
+        entriesOpen(sdk_model_dir);
+    }
+    return true;
+}
+
+// Reset works on the model directory and does not need a loaded model
+bool predictorReset(const char* modelDir) {
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    SdkThreadScope threads;
+    bool result = reset_func(modelDir);
+    if (result) {
+        if (journal_fd >= 0) {
+            journalTruncate();
+            entriesTruncate();
+        } else {
+            unlink((std::string(modelDir) + "/" + JOURNAL_FILE).c_str());
+            // Keep an enabled store enabled, now covering the empty gallery
+            std::string path = std::string(modelDir) + "/" + ENTRIES_FILE;
+            int fd = open(path.c_str(), O_WRONLY | O_TRUNC | O_CLOEXEC);
+            if (fd >= 0) {
+                std::string header = entriesHeader(true);
+                if (write(fd, header.data(), header.size()) != static_cast<ssize_t>(header.size())) {
+                    std::cerr << "Failed to initialise entry store" << std::endl;
+                }
+                close(fd);
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * Move every entry of from to to; renaming onto an existing label merges
+ * the two. Only from's entries are read and registered again, using the
+ * label index of the entry store. The SDK can only delete a label as a
+ * whole, so from is only renamed when the store covers it in full (see the
+ * entry store) and all its images can be read back. Entries keep their
+ * registration time, so delta exports do not ship them again. If the SDK
+ * rejects an entry part way, the rename stops and the entries not yet moved
+ * are registered back under from.
+ * @return number of entries moved, or -1 if from could not be renamed in full
+ */
+int predictorRenameLabel(SmartPredictor* handle, const char* from, const char* to) {
+    if (!handle || std::strcmp(from, to) == 0) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    if (entries_fd < 0 || !labelCoveredLocked(from)) {
+        return -1;
+    }
+    std::vector<std::pair<GalleryRecord, std::vector<unsigned char> > > moved;
+    std::map<std::string, std::vector<GalleryRecord> >::const_iterator entries = gallery_entries.find(from);
+    for (size_t i = 0; entries != gallery_entries.end() && i < entries->second.size(); ++i) {
+        moved.push_back(std::make_pair(entries->second[i], std::vector<unsigned char>()));
+        if (!readRecordImage(entries_fd, entries->second[i], &moved.back().second)) {
+            return -1;
+        }
+    }
+    SdkThreadScope threads;
+    StageStart start = stageStart();
+    bool deleted = delete_func(from);
+    recordStage(STAT_DELETE, start, deleted);
+    if (!deleted) {
+        return -1;
+    }
+    int64_t now = nowMs();
+    journalAppend('D', now, from, 0, nullptr, 0);
+    entriesAppend('D', now, from, 0, nullptr, 0);
+    noteUnsavedChange();
+    int count = 0;
+    const char* target = to;
+    for (size_t i = 0; i < moved.size(); ++i) {
+        unsigned char* image = moved[i].second.data();
+        long size = static_cast<long>(moved[i].second.size());
+        int64_t timestamp = moved[i].first.timestamp;
+        start = stageStart();
+        int result = regist_func(image, size, target, moved[i].first.pos);
+        recordStage(STAT_REGIST, start, result >= 0);
+        if (result < 0 && target == to) {
+            // Put this entry and the rest back under from
+            target = from;
+            start = stageStart();
+            result = regist_func(image, size, target, moved[i].first.pos);
+            recordStage(STAT_REGIST, start, result >= 0);
+        }
+        if (result < 0) {
+            std::cerr << "Failed to restore an entry of " << from << " while renaming it" << std::endl;
+            continue;
+        }
+        journalAppend('R', timestamp, target, moved[i].first.pos, image, size);
+        entriesAppend('R', timestamp, target, moved[i].first.pos, image, size);
+        noteUnsavedChange();
+        count += target == to ? 1 : 0;
+    }
+    return target == to ? count : -1;
+}
+
+/**
+ * Labels of the entry store with their entry counts, in label order; no
+ * gallery scan is involved. The SDK cannot list its gallery, so labels and
+ * entries it holds from before the store existed, or that were registered
+ * without this layer, are missing or undercounted.
+ */
+void predictorListLabels(std::vector<LabelCount>* labels) {
+    labels->clear();
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    for (std::map<std::string, std::vector<GalleryRecord> >::const_iterator it = gallery_entries.begin();
+         it != gallery_entries.end(); ++it) {
+        LabelCount count;
+        count.labelId = internLabel(it->first);
+        count.label = it->first;
+        count.samples = static_cast<long>(it->second.size());
+        labels->push_back(count);
+    }
+}
+
+bool predictorDelete(SmartPredictor* handle, const char* label) {
+    if (!handle) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    SdkThreadScope threads;
+    StageStart start = stageStart();
+    bool result = delete_func(label);
+    recordStage(STAT_DELETE, start, result);
+    if (result) {
+        int64_t now = nowMs();
+        journalAppend('D', now, label, 0, nullptr, 0);
+        entriesAppend('D', now, label, 0, nullptr, 0);
+        noteUnsavedChange();
+    }
+    return result;
+}
+
+// Deliver a completion through its callback, or queue it and signal the eventfd
+static void completeAsync(const AsyncJob& job, int result, const char* json) {
+    PredictCompletion completion;
+    completion.requestId = job.requestId;
+    completion.lane = job.lane;
+    completion.result = result;
+    completion.json = json;
+    if (job.callback) {
+        job.callback(completion, job.userData);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(async_mutex);
+    async_done.push_back(completion);
+    uint64_t one = 1;
+    if (write(async_event_fd, &one, sizeof(one)) != sizeof(one)) {
+        std::cerr << "Failed to signal async completion" << std::endl;
+    }
+}
+
+static bool isSuperseded(const AsyncJob& job) {
+    std::lock_guard<std::mutex> lock(async_mutex);
+    return async_latest[job.lane] != job.requestId;
+}
+
+static void asyncWorker() {
+    std::vector<char> buffer(4096);
+    for (;;) {
+        AsyncJob job;
+        {
+            std::unique_lock<std::mutex> lock(async_mutex);
+            async_cv.wait(lock, [] { return async_stop || !async_jobs.empty(); });
+            if (async_stop) {
+                return;
+            }
+            job = std::move(async_jobs.front());
+            async_jobs.pop_front();
+        }
+        if (isSuperseded(job)) {
+            completeAsync(job, PREDICT_CANCELLED, "");
+            continue;
+        }
+        int result = predictGrowing(job.handle, job.image.data(), static_cast<long>(job.image.size()),
+                                    job.filterSim, &buffer);
+        // A newer request arrived while this one ran; its result is stale
+        if (isSuperseded(job)) {
+            completeAsync(job, PREDICT_CANCELLED, "");
+        } else {
+            completeAsync(job, result, result >= 0 ? buffer.data() : "");
+        }
+    }
+}
+
+/**
+ * Queue a prediction and return immediately. The image bytes are copied.
+ * A newer request on the same lane cancels older ones that have not
+ * completed; they finish with PREDICT_CANCELLED. A result too large for
+ * MAX_RESULT_BYTES finishes with PREDICT_TRUNCATED. With a callback the
+ * result is delivered on a worker thread, otherwise it is queued for
+ * predictAsyncPoll() and predictAsyncFd() becomes readable.
+ * The handle must stay alive until the request completes.
+ * @return request id (> 0), or -1 if the worker pool could not start
+ */
+long predictAsync(SmartPredictor* handle, int lane, const unsigned char* imgBytes, long byteSize,
+                  float filterSim, PredictCallback callback, void* userData) {
+    std::lock_guard<std::mutex> lock(async_mutex);
+    if (async_workers.empty()) {
+        async_event_fd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE | EFD_CLOEXEC);
+        if (async_event_fd < 0) {
+            return -1;
+        }
+        async_stop = false;
+        for (int i = 0; i < ASYNC_WORKERS; ++i) {
+            async_workers.push_back(std::thread(asyncWorker));
+        }
+    }
+    AsyncJob job;
+    job.requestId = async_next_id++;
+    job.lane = lane;
+    job.handle = handle;
+    job.image.assign(imgBytes, imgBytes + byteSize);
+    job.filterSim = filterSim;
+    job.callback = callback;
+    job.userData = userData;
+    async_latest[lane] = job.requestId;
+    async_jobs.push_back(std::move(job));
+    async_cv.notify_one();
+    return async_latest[lane];
+}
+
+// Completion queue eventfd (semaphore mode), or -1 before the first predictAsync
+int predictAsyncFd() {
+    std::lock_guard<std::mutex> lock(async_mutex);
+    return async_event_fd;
+}
+
+// Pop one queued completion; returns false if the queue is empty
+bool predictAsyncPoll(PredictCompletion* completion) {
+    std::lock_guard<std::mutex> lock(async_mutex);
+    if (async_done.empty()) {
+        return false;
+    }
+    *completion = async_done.front();
+    async_done.pop_front();
+    uint64_t count;
+    if (read(async_event_fd, &count, sizeof(count)) != sizeof(count)) {
+        std::cerr << "Async completion queue out of sync" << std::endl;
+    }
+    return true;
+}
+
+// Stop the worker pool; queued requests that have not started are dropped
+void predictAsyncShutdown() {
+    {
+        std::lock_guard<std::mutex> lock(async_mutex);
+        async_stop = true;
+    }
+    async_cv.notify_all();
+    for (size_t i = 0; i < async_workers.size(); ++i) {
+        async_workers[i].join();
+    }
+    async_workers.clear();
+    async_jobs.clear();
+    async_done.clear();
+    if (async_event_fd >= 0) {
+        close(async_event_fd);
+        async_event_fd = -1;
+    }
+}
+
+/**
+ * Predict and keep the image under a token, so the cashier's choice can be
+ * registered with registByToken() without the caller holding on to the
+ * JPEG. Only the TOKEN_CACHE_SIZE most recent tokens stay valid.
+ * @param token receives the token, or 0 if the prediction failed
+ */
+int predictWithToken(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, float filterSim,
+                     char* result, long resultSize, long* token) {
+    *token = 0;
+    int predictResult = predictorPredict(handle, imgBytes, byteSize, filterSim, result, resultSize);
+    if (predictResult < 0) {
+        return predictResult;
+    }
+    std::lock_guard<std::mutex> lock(token_mutex);
+    *token = token_next++;
+    token_images.push_front(std::make_pair(*token, std::vector<unsigned char>(imgBytes, imgBytes + byteSize)));
+    token_index[*token] = token_images.begin();
+    if (static_cast<int>(token_images.size()) > TOKEN_CACHE_SIZE) {
+        token_index.erase(token_images.back().first);
+        token_images.pop_back();
+    }
+    return predictResult;
+}
+
+/**
+ * Register the image of an earlier predictWithToken() call. The token is
+ * consumed.
+ * @return the predictorRegist result, or -1 if the token has expired
+ */
+int registByToken(SmartPredictor* handle, long token, const char* label, int pos) {
+    std::vector<unsigned char> image;
+    {
+        std::lock_guard<std::mutex> lock(token_mutex);
+        std::map<long, std::list<std::pair<long, std::vector<unsigned char> > >::iterator>::iterator it =
+            token_index.find(token);
+        if (it == token_index.end()) {
+            return -1;
+        }
+        image.swap(it->second->second);
+        token_images.erase(it->second);
+        token_index.erase(it);
+    }
+    return predictorRegist(handle, image.data(), static_cast<long>(image.size()), label, pos);
+}
+
+/**
+ * Predict a burst of images in one call. The SDK has no batch entry point,
+ * so the frames still run one forward pass each; this keeps the call site
+ * ready for a native batch without changing callers.
+ * codes[i] receives the return value of the single-image prediction for image i,
+ * results[i] must point to a buffer of resultSize bytes.
+ * @return number of images predicted successfully
+ */
+int predictBatch(SmartPredictor* handle, unsigned char** imgBytes, const long* byteSizes, int count, float filterSim,
+                 char** results, long resultSize, int* codes) {
+    int succeeded = 0;
+    for (int i = 0; i < count; ++i) {
+        codes[i] = predictorPredict(handle, imgBytes[i], byteSizes[i], filterSim, results[i], resultSize);
+        if (codes[i] >= 0) {
+            ++succeeded;
+        }
+    }
+    return succeeded;
+}
+
+/**
+ * Intern a label and return its id. Ids are stable for the life of the
+ * process, so callers can keep them instead of comparing label strings.
+ */
+int internLabel(const std::string& label) {
+    std::lock_guard<std::mutex> lock(label_mutex);
+    std::map<std::string, int>::iterator it = label_ids.find(label);
+    if (it != label_ids.end()) {
+        return it->second;
+    }
+    int labelId = static_cast<int>(label_table.size());
+    label_table.push_back(label);
+    label_ids[label] = labelId;
+    return labelId;
+}
+
+const char* labelName(int labelId) {
+    std::lock_guard<std::mutex> lock(label_mutex);
+    if (labelId < 0 || labelId >= static_cast<int>(label_table.size())) {
+        return "";
+    }
+    return label_table[labelId].c_str();
+}
+
+// Read a JSON string literal starting at the opening quote; returns the position after the closing quote
+static const char* readJsonString(const char* p, std::string& out) {
+    out.clear();
+    for (++p; *p && *p != '"'; ++p) {
+        if (*p == '\\' && p[1]) {
+            ++p;
+        }
+        out += *p;
+    }
+    return *p == '"' ? p + 1 : nullptr;
+}
+
+// Keeps the maxScores best candidates in JSON order and returns how many there were in total
+static int parseScoresText(const char* json, PredictScore* scores, int maxScores, int* scoreCount) {
+    *scoreCount = 0;
+    int total = 0;
+    const char* p = std::strstr(json, "\"scores\"");
+    if (!p || !(p = std::strchr(p, '['))) {
+        return -1;
+    }
+    std::string label;
+    std::string score;
+    for (++p; *p; ++p) {
+        if (*p == ']') {
+            return total;
+        }
+        if (*p != '[') {
+            continue;
+        }
+        if (!(p = std::strchr(p, '"')) || !(p = readJsonString(p, label))) {
+            return -1;
+        }
+        if (!(p = std::strchr(p, '"')) || !(p = readJsonString(p, score))) {
+            return -1;
+        }
+        if (!(p = std::strchr(p, ']'))) {
+            return -1;
+        }
+        ++total;
+        PredictScore candidate = { 0, std::strtof(score.c_str(), nullptr) };
+        if (*scoreCount == maxScores) {
+            // Full: drop the weakest kept candidate if this one beats it
+            int weakest = 0;
+            for (int i = 1; i < *scoreCount; ++i) {
+                if (scores[i].score < scores[weakest].score) {
+                    weakest = i;
+                }
+            }
+            if (maxScores == 0 || candidate.score <= scores[weakest].score) {
+                continue;
+            }
+            std::copy(scores + weakest + 1, scores + *scoreCount, scores + weakest);
+            --*scoreCount;
+        }
+        candidate.labelId = internLabel(label);
+        scores[(*scoreCount)++] = candidate;
+    }
+    return -1;
+}
+
+/**
+ * Parse the JSON written by SmartPredictor_predict_img into score structs.
+ * With more than maxScores candidates, the maxScores best are kept.
+ * @return number of candidates in the JSON, which exceeds *scoreCount when
+ *         some were dropped, or -1 if the text is malformed or was truncated
+ */
+int parseScores(const char* json, PredictScore* scores, int maxScores, int* scoreCount) {
+    StageStart start = stageStart();
+    int result = parseScoresText(json, scores, maxScores, scoreCount);
+    recordStage(STAT_PARSE, start, result >= 0);
+    return result;
+}
+
+/**
+ * Predict into an array of {labelId, score} structs instead of JSON text.
+ * The result buffer grows and the prediction is retried when the JSON does
+ * not fit. At most maxScores candidates are kept, the best ones; totalCount,
+ * when given, receives how many the SDK returned.
+ * @return the SmartPredictor_predict_img result, PREDICT_TRUNCATED, or -1 if
+ *         the result could not be parsed
+ */
+int predictScores(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, float filterSim,
+                  PredictScore* scores, int maxScores, int* scoreCount, int* totalCount) {
+    static thread_local std::vector<char> buffer(4096);
+    *scoreCount = 0;
+    int result = predictGrowing(handle, imgBytes, byteSize, filterSim, &buffer);
+    if (result < 0) {
+        return result;
+    }
+    int total = parseScores(buffer.data(), scores, maxScores, scoreCount);
+    if (totalCount) {
+        *totalCount = std::max(total, 0);
+    }
+    return total >= 0 ? result : -1;
+}
+
+/**
+ * Run throw-away predictions so the first real one after a load does not pay
+ * for lazy allocation and cold caches. Predicting with a zero threshold returns
+ * the longest candidate list, which also grows the calling thread's
+ * predictScores buffer to its steady-state size.
+ * @return number of rounds that succeeded, or the first error if none did
+ */
+int predictorWarmup(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, int rounds) {
+    int succeeded = 0;
+    int error = -1;
+    for (int i = 0; i < rounds; ++i) {
+        PredictScore scores[MAX_SCORES];
+        int scoreCount = 0;
+        int result = predictScores(handle, imgBytes, byteSize, 0.0f, scores, MAX_SCORES, &scoreCount);
+        if (result >= 0) {
+            ++succeeded;
+        } else if (succeeded == 0) {
+            error = result;
+        }
+    }
+    return succeeded > 0 || rounds <= 0 ? succeeded : error;
+}
+
+// One file of a bulk import, read by a reader thread
+struct ImportItem {
+    size_t index;
+    std::vector<unsigned char> bytes;
+    bool readOk;
+};
+
+/**
+ * Register every image under imageDir/<label>/ and save once at the end.
+ * Reader threads load files into a bounded queue while this thread registers
+ * them in batches under one hold of the SDK lock. Feature extraction runs
+ * inside SmartPredictor_regist_img, which the SDK cannot run concurrently, so
+ * the readers only take file I/O off the registering thread. Each batch is
+ * journaled with one sync before it reaches the entry store, so a crash
+ * mid-import leaves the SDK and the store agreeing once the journal is
+ * replayed. The import saves whenever the journal passes
+ * JOURNAL_COMPACT_BYTES; if the final save fails, the entries since the
+ * last save count as unsaved registrations, so autosave retries it.
+ * @return number of images registered, or -1 if imageDir could not be listed
+ */
+int predictorImport(SmartPredictor* handle, const char* imageDir, int pos, int readers, ImportReport* report) {
+    auto start = std::chrono::steady_clock::now();
+    report->files = 0;
+    report->imported = 0;
+    report->seconds = 0.0;
+    report->saveResult = 0;
+    report->failures.clear();
+    if (!handle) {
+        return -1;
+    }
+    std::vector<std::pair<std::string, std::string> > files;
+    if (!listLabelFiles(imageDir, &files)) {
+        return -1;
+    }
+    report->files = static_cast<long>(files.size());
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<ImportItem> queue;
+    std::atomic<size_t> next_file(0);
+    int readerCount = std::max(1, readers);
+    int readersLeft = readerCount;
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readerCount; ++r) {
+        threads.push_back(std::thread([&] {
+            for (size_t i = next_file++; i < files.size(); i = next_file++) {
+                ImportItem item;
+                item.index = i;
+                item.readOk = true;
+                try {
+                    item.bytes = readImage(files[i].first);
+                } catch (const std::exception&) {
+                    item.readOk = false;
+                }
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_cv.wait(lock, [&] { return static_cast<int>(queue.size()) < IMPORT_QUEUE_DEPTH; });
+                queue.push_back(std::move(item));
+                queue_cv.notify_all();
+            }
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            --readersLeft;
+            queue_cv.notify_all();
+        }));
+    }
+
+    std::vector<ImportItem> batch;
+    std::vector<size_t> registered;  // Indexes into batch
+    long unsaved = 0;
+    for (;;) {
+        batch.clear();
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [&] { return !queue.empty() || readersLeft == 0; });
+            while (!queue.empty() && static_cast<int>(batch.size()) < IMPORT_BATCH) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+            queue_cv.notify_all();
+        }
+        if (batch.empty()) {
+            break;
+        }
+        std::lock_guard<std::mutex> lock(sdk_mutex);
+        SdkThreadScope threads;
+        registered.clear();
+        for (size_t b = 0; b < batch.size(); ++b) {
+            const std::pair<std::string, std::string>& file = files[batch[b].index];
+            int result = -1;
+            if (batch[b].readOk && !batch[b].bytes.empty()) {
+                StageStart stageBegin = stageStart();
+                result = regist_func(batch[b].bytes.data(), static_cast<long>(batch[b].bytes.size()),
+                                     file.second.c_str(), pos);
+                recordStage(STAT_REGIST, stageBegin, result >= 0);
+            }
+            if (result >= 0) {
+                registered.push_back(b);
+            } else {
+                ImportFailure failure;
+                failure.path = file.first;
+                failure.result = result;
+                report->failures.push_back(failure);
+            }
+        }
+        int64_t now = nowMs();
+        for (size_t r = 0; r < registered.size(); ++r) {
+            const ImportItem& item = batch[registered[r]];
+            journalAppend('R', now, files[item.index].second.c_str(), pos, item.bytes.data(),
+                          static_cast<long>(item.bytes.size()), false);
+        }
+        journalSync();
+        for (size_t r = 0; r < registered.size(); ++r) {
+            const ImportItem& item = batch[registered[r]];
+            entriesAppend('R', now, files[item.index].second.c_str(), pos, item.bytes.data(),
+                          static_cast<long>(item.bytes.size()));
+        }
+        report->imported += static_cast<long>(registered.size());
+        unsaved += static_cast<long>(registered.size());
+        if (journal_bytes >= JOURNAL_COMPACT_BYTES && saveLocked(handle->modelDir) >= 0) {
+            unsaved = 0;
+        }
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+
+    if (report->imported > 0) {
+        std::lock_guard<std::mutex> lock(sdk_mutex);
+        report->saveResult = saveLocked(handle->modelDir);
+        if (report->saveResult < 0) {
+            noteUnsavedBulk(unsaved);
+        }
+    }
+    report->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<int>(report->imported);
+}
+
+// Cap of 0 leaves the label uncapped; a null label sets the default for every label
+void predictorSetLabelCap(const char* label, int cap) {
+    std::lock_guard<std::mutex> lock(sdk_mutex);
+    if (label) {
+        label_caps[label] = std::max(0, cap);
+    } else {
+        default_label_cap = std::max(0, cap);
+    }
+}
+
+// A tracked entry and its image, held while its label is rebuilt
+typedef std::pair<GalleryRecord, std::vector<unsigned char> > LoadedEntry;
+
+/**
+ * Delete label and register back its newest entries up to its cap. Before
+ * an entry is registered it is predicted against what was kept so far, and
+ * it is dropped if it matches the label at DUPLICATE_SIMILARITY or more.
+ * The SDK is left untouched when an image cannot be read back or the
+ * delete fails. Called with sdk_mutex held.
+ * @return whether the label was rebuilt; kept receives its entries, oldest first
+ */
+static bool rebuildLabelLocked(const std::string& label, CompactReport* report, std::vector<LoadedEntry>* kept) {
+    std::vector<LoadedEntry> candidates;
+    const std::vector<GalleryRecord>& entries = gallery_entries[label];
+    for (size_t i = entries.size(); i-- > 0;) {
+        candidates.push_back(LoadedEntry(entries[i], std::vector<unsigned char>()));
+        if (!readRecordImage(entries_fd, entries[i], &candidates.back().second)) {
+            return false;
+        }
+    }
+    StageStart start = stageStart();
+    bool deleted = delete_func(label.c_str());
+    recordStage(STAT_DELETE, start, deleted);
+    if (!deleted) {
+        return false;
+    }
+    kept->clear();
+    std::map<std::string, int>::const_iterator capIt = label_caps.find(label);
+    size_t cap = static_cast<size_t>(capIt != label_caps.end() ? capIt->second : default_label_cap);
+    std::vector<char> buffer(16384);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        unsigned char* image = candidates[i].second.data();
+        long size = static_cast<long>(candidates[i].second.size());
+        if (cap > 0 && kept->size() >= cap) {
+            ++report->evicted;
+            continue;
+        }
+        if (!kept->empty()) {
+            PredictScore scores[MAX_SCORES];
+            int scoreCount = 0;
+            buffer[0] = '\0';
+            float best = 0.0f;
+            StageStart predictStart = stageStart();
+            int predicted = predict_func(image, size, 0.0f, buffer.data(), static_cast<long>(buffer.size()));
+            recordStage(STAT_PREDICT, predictStart, predicted >= 0);
+            if (predicted >= 0 && parseScoresText(buffer.data(), scores, MAX_SCORES, &scoreCount) >= 0) {
+                for (int s = 0; s < scoreCount; ++s) {
+                    if (scores[s].score > best && label == labelName(scores[s].labelId)) {
+                        best = scores[s].score;
+                    }
+                }
+            }
+            if (best >= DUPLICATE_SIMILARITY) {
+                ++report->duplicates;
+                continue;
+            }
+        }
+        StageStart registStart = stageStart();
+        int registered = regist_func(image, size, label.c_str(), candidates[i].first.pos);
+        recordStage(STAT_REGIST, registStart, registered >= 0);
+        if (registered >= 0) {
+            kept->push_back(candidates[i]);
+        } else {
+            ++report->evicted;
+        }
+    }
+    std::reverse(kept->begin(), kept->end());
+    return true;
+}
+
+// Bytes the indexed records would take in a freshly written store; called with sdk_mutex held
+static uint64_t entriesLiveBytesLocked() {
+    uint64_t bytes = entriesHeader(store_covers_all).size();
+    for (std::map<std::string, std::vector<GalleryRecord> >::const_iterator it = gallery_entries.begin();
+         it != gallery_entries.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            bytes += 25 + it->first.size() + it->second[i].imageSize;
+        }
+    }
+    return bytes;
+}
+
+/**
+ * Replace the entry store with the records of its index, dropping those that
+ * later records superseded. Covered labels keep a 'D' record ahead of their
+ * entries so they stay covered. Called with sdk_mutex held.
+ */
+static void entriesRewriteLocked() {
+    std::string path = sdk_model_dir + "/" + ENTRIES_FILE;
+    std::string tmpPath = path + ".tmp";
+    std::string header = entriesHeader(store_covers_all);
+    int fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0 || write(fd, header.data(), header.size()) != static_cast<ssize_t>(header.size())) {
+        std::cerr << "Failed to rewrite entry store" << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    std::set<std::string> labels(covered_labels);
+    for (std::map<std::string, std::vector<GalleryRecord> >::const_iterator it = gallery_entries.begin();
+         it != gallery_entries.end(); ++it) {
+        labels.insert(it->first);
+    }
+    std::map<std::string, std::vector<GalleryRecord> > index;
+    uint64_t bytes = header.size();
+    bool ok = true;
+    std::vector<unsigned char> image;
+    for (std::set<std::string>::const_iterator label = labels.begin(); ok && label != labels.end(); ++label) {
+        if (!store_covers_all && covered_labels.count(*label) > 0) {
+            std::string encoded = encodeRecord('D', nowMs(), label->c_str(), 0, nullptr, 0);
+            ok = write(fd, encoded.data(), encoded.size()) == static_cast<ssize_t>(encoded.size());
+            bytes += encoded.size();
+        }
+        const std::vector<GalleryRecord>& entries = gallery_entries[*label];
+        for (size_t i = 0; ok && i < entries.size(); ++i) {
+            GalleryRecord record = entries[i];
+            if (!readRecordImage(entries_fd, record, &image)) {
+                ok = false;
+                break;
+            }
+            std::string encoded = encodeRecord(record.op, record.timestamp, label->c_str(), record.pos,
+                                               image.data(), static_cast<long>(image.size()));
+            ok = write(fd, encoded.data(), encoded.size()) == static_cast<ssize_t>(encoded.size());
+            record.imageOffset = bytes + 21 + record.label.size();
+            bytes += encoded.size();
+            index[*label].push_back(record);
+        }
+    }
+    if (!ok || fdatasync(fd) != 0 || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to rewrite entry store" << std::endl;
+        close(fd);
+        unlink(tmpPath.c_str());
+        return;
+    }
+    close(entries_fd);
+    entries_fd = fd;
+    entries_bytes = bytes;
+    gallery_entries.swap(index);
+    label_hashes.clear();
+}
+
+/**
+ * Prune label, or every tracked label if it is null: near-duplicates are
+ * collapsed onto the newest entry and the oldest entries beyond the label's
+ * cap are evicted. Only labels the entry store covers in full are rebuilt
+ * (see the entry store); others are counted in report->skippedLabels and
+ * keep all their entries. The SDK lock is taken per label, so predictions
+ * and registrations continue between labels. Each rebuilt label is
+ * journaled like a delete followed by registrations, so a crash before the
+ * final save replays it. If that save fails, the changes count as unsaved
+ * and autosave retries it. After a successful save the store is rewritten
+ * once superseded records make up half of it.
+ * @return number of entries pruned, or -1 without a handle or entry store
+ */
+int predictorCompact(SmartPredictor* handle, const char* label, CompactReport* report) {
+    report->entriesBefore = 0;
+    report->entriesAfter = 0;
+    report->duplicates = 0;
+    report->evicted = 0;
+    report->skippedLabels = 0;
+    report->saveResult = 0;
+    if (!handle) {
+        return -1;
+    }
+    std::vector<std::string> labels;
+    {
+        std::lock_guard<std::mutex> lock(sdk_mutex);
+        if (entries_fd < 0) {
+            return -1;
+        }
+        for (std::map<std::string, std::vector<GalleryRecord> >::const_iterator it = gallery_entries.begin();
+             it != gallery_entries.end(); ++it) {
+            if (!label || it->first == label) {
+                labels.push_back(it->first);
+            }
+        }
+    }
+    long changes = 0;  // Deletes and registrations made through the SDK
+    for (size_t l = 0; l < labels.size(); ++l) {
+        std::lock_guard<std::mutex> lock(sdk_mutex);
+        SdkThreadScope threads;
+        std::map<std::string, std::vector<GalleryRecord> >::const_iterator it = gallery_entries.find(labels[l]);
+        if (it == gallery_entries.end()) {
+            continue;
+        }
+        long before = static_cast<long>(it->second.size());
+        std::vector<LoadedEntry> kept;
+        if (before >= 2 && (!labelCoveredLocked(labels[l]) || !rebuildLabelLocked(labels[l], report, &kept))) {
+            ++report->skippedLabels;
+            continue;
+        }
+        report->entriesBefore += before;
+        if (before < 2) {
+            report->entriesAfter += before;
+            continue;
+        }
+        report->entriesAfter += static_cast<long>(kept.size());
+        // Kept entries keep their registration time, so delta exports do not ship them again
+        int64_t now = nowMs();
+        journalAppend('D', now, labels[l].c_str(), 0, nullptr, 0, false);
+        for (size_t i = 0; i < kept.size(); ++i) {
+            journalAppend('R', kept[i].first.timestamp, labels[l].c_str(), kept[i].first.pos,
+                          kept[i].second.data(), static_cast<long>(kept[i].second.size()), false);
+        }
+        journalSync();
+        entriesAppend('D', now, labels[l].c_str(), 0, nullptr, 0);
+        for (size_t i = 0; i < kept.size(); ++i) {
+            entriesAppend('R', kept[i].first.timestamp, labels[l].c_str(), kept[i].first.pos,
+                          kept[i].second.data(), static_cast<long>(kept[i].second.size()));
+        }
+        changes += 1 + static_cast<long>(kept.size());
+    }
+    if (changes > 0) {
+        std::lock_guard<std::mutex> lock(sdk_mutex);
+        report->saveResult = saveLocked(handle->modelDir);
+        if (report->saveResult < 0) {
+            noteUnsavedBulk(changes);
+        }
+        // Only once the save has emptied the journal: the rewrite drops superseded
+        // records that a replayed journal would otherwise append out of order
+        if (report->saveResult >= 0 && entries_fd >= 0 && entriesLiveBytesLocked() * 2 < entries_bytes) {
+            entriesRewriteLocked();
+        }
+    }
+    return static_cast<int>(report->entriesBefore - report->entriesAfter);
+}
+
+/**
+ * Export file. The tracked entries registered at or after a timestamp, in
+ * the entry store's record layout, after a header of:
+ *   magic "RXG1" (4) | version (4) | exported at ms (8) | since ms (8) | record count (4)
+ * Features are internal to the SDK, so entries travel as their images and
+ * are registered again on the receiving terminal.
+ */
+const char EXPORT_MAGIC[4] = { 'R', 'X', 'G', '1' };
+const size_t EXPORT_HEADER_SIZE = 28;
+
+/**
+ * Write the tracked entries registered at or after sinceMs (0 for all of
+ * them) to path. Label deletes are not exported. The SDK lock is only held
+ * to list the entries; images are read from a descriptor of the store as it
+ * was then, so a concurrent rewrite cannot move them.
+ * @return number of entries written, or -1 on failure
+ */
+long predictorExportGallery(SmartPredictor* handle, const char* path, long long sinceMs) {
+    if (!handle) {
+        return -1;
+    }
+    std::string tmpPath = std::string(path) + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    std::string header(EXPORT_MAGIC, sizeof(EXPORT_MAGIC));
+    putValue<uint32_t>(header, EXPORT_VERSION);
+    putValue<int64_t>(header, nowMs());
+    putValue<int64_t>(header, sinceMs);
+    putValue<uint32_t>(header, 0);
+    bool ok = write(fd, header.data(), header.size()) == static_cast<ssize_t>(header.size());
+    std::vector<GalleryRecord> records;
+    int storeFd = -1;
+    {
+        std::lock_guard<std::mutex> lock(sdk_mutex);
+        if (entries_fd >= 0) {
+            storeFd = fcntl(entries_fd, F_DUPFD_CLOEXEC, 0);
+        }
+        for (std::map<std::string, std::vector<GalleryRecord> >::const_iterator it = gallery_entries.begin();
+             it != gallery_entries.end(); ++it) {
+            for (size_t i = 0; i < it->second.size(); ++i) {
+                if (it->second[i].timestamp >= sinceMs) {
+                    records.push_back(it->second[i]);
+                }
+            }
+        }
+    }
+    ok = ok && storeFd >= 0;
+    uint32_t count = 0;
+    std::vector<unsigned char> image;
+    for (size_t i = 0; ok && i < records.size(); ++i) {
+        // A reset truncating the store meanwhile fails the checksum, and the entry is left out
+        if (!readRecordImage(storeFd, records[i], &image)) {
+            continue;
+        }
+        std::string encoded = encodeRecord('R', records[i].timestamp, records[i].label.c_str(), records[i].pos,
+                                           image.data(), static_cast<long>(image.size()));
+        ok = write(fd, encoded.data(), encoded.size()) == static_cast<ssize_t>(encoded.size());
+        ++count;
+    }
+    if (storeFd >= 0) {
+        close(storeFd);
+    }
+    ok = ok && pwrite(fd, &count, sizeof(count), EXPORT_HEADER_SIZE - sizeof(count)) == sizeof(count) &&
+         fdatasync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmpPath.c_str(), path) != 0) {
+        unlink(tmpPath.c_str());
+        return -1;
+    }
+    return static_cast<long>(count);
+}
+
+// Hashes of the images tracked under label, read from the entry store on first use
+static std::set<uint64_t>& labelHashesLocked(const std::string& label) {
+    std::map<std::string, std::set<uint64_t> >::iterator it = label_hashes.find(label);
+    if (it != label_hashes.end()) {
+        return it->second;
+    }
+    std::set<uint64_t>& hashes = label_hashes[label];
+    std::map<std::string, std::vector<GalleryRecord> >::const_iterator entries = gallery_entries.find(label);
+    std::vector<unsigned char> image;
+    for (size_t i = 0; entries != gallery_entries.end() && i < entries->second.size(); ++i) {
+        if (readRecordImage(entries_fd, entries->second[i], &image)) {
+            hashes.insert(fnv1a64(image.data(), image.size()));
+        }
+    }
+    return hashes;
+}
+
+/**
+ * Merge an export file into the live model without reloading it. Labels
+ * are renamed through labelMap; a label mapped to "" is skipped. An entry
+ * is skipped when its label already has an image with the same content.
+ * Merged entries keep the registration time they have in the export, so a
+ * delta export from here ships them again only if it reaches that far back.
+ * As in predictorImport, entries are registered and journaled in batches of
+ * IMPORT_BATCH under one hold of the SDK lock, so predictions continue
+ * between batches; the model is saved at the end, and whenever the journal
+ * passes JOURNAL_COMPACT_BYTES. If the final save fails the entries since
+ * the last save count as unsaved registrations, so autosave retries it.
+ * @return number of entries merged, or -1 if the file is not a readable
+ *         export or the entry store, which detects duplicates, is off
+ */
+int predictorMergeGallery(SmartPredictor* handle, const char* path,
+                          const std::map<std::string, std::string>& labelMap, MergeReport* report) {
+    auto start = std::chrono::steady_clock::now();
+    report->records = 0;
+    report->imported = 0;
+    report->duplicates = 0;
+    report->unmapped = 0;
+    report->failed = 0;
+    report->seconds = 0.0;
+    report->saveResult = 0;
+    if (!handle) {
+        return -1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sdk_mutex);
+        if (entries_fd < 0) {
+            return -1;
+        }
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    std::string header(EXPORT_HEADER_SIZE, '\0');
+    size_t headerOffset = sizeof(EXPORT_MAGIC);
+    uint32_t version = 0;
+    if (fstat(fd, &st) != 0 ||
+        pread(fd, &header[0], header.size(), 0) != static_cast<ssize_t>(header.size()) ||
+        std::memcmp(header.data(), EXPORT_MAGIC, sizeof(EXPORT_MAGIC)) != 0 ||
+        !getValue(header, headerOffset, &version) || version != EXPORT_VERSION) {
+        close(fd);
+        return -1;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+    uint64_t offset = EXPORT_HEADER_SIZE;
+    GalleryRecord record;
+    uint64_t next;
+    std::vector<LoadedEntry> batch;  // Records relabelled through labelMap, with their images
+    std::vector<size_t> registered;  // Indexes into batch
+    long unsaved = 0;
+    bool more = true;
+    while (more) {
+        // The export is read without the SDK lock
+        batch.clear();
+        while (static_cast<int>(batch.size()) < IMPORT_BATCH &&
+               (more = readRecordHeader(fd, offset, fileSize, &record, &next))) {
+            offset = next;
+            ++report->records;
+            std::map<std::string, std::string>::const_iterator mapped = labelMap.find(record.label);
+            record.label = mapped != labelMap.end() ? mapped->second : record.label;
+            if (record.label.empty()) {
+                ++report->unmapped;
+                continue;
+            }
+            batch.push_back(LoadedEntry(record, std::vector<unsigned char>()));
+            if (record.op != 'R' || !readRecordImage(fd, record, &batch.back().second) || batch.back().second.empty()) {
+                ++report->failed;
+                batch.pop_back();
+            }
+        }
+        if (batch.empty()) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(sdk_mutex);
+        SdkThreadScope threads;
+        registered.clear();
+        for (size_t b = 0; b < batch.size(); ++b) {
+            const GalleryRecord& entry = batch[b].first;
+            std::vector<unsigned char>& image = batch[b].second;
+            // Registered images join their label's hashes, so duplicates within the export are caught too
+            std::set<uint64_t>& hashes = labelHashesLocked(entry.label);
+            if (hashes.count(fnv1a64(image.data(), image.size())) > 0) {
+                ++report->duplicates;
+                continue;
+            }
+            StageStart stageBegin = stageStart();
+            int result = regist_func(image.data(), static_cast<long>(image.size()), entry.label.c_str(), entry.pos);
+            recordStage(STAT_REGIST, stageBegin, result >= 0);
+            if (result < 0) {
+                ++report->failed;
+                continue;
+            }
+            hashes.insert(fnv1a64(image.data(), image.size()));
+            registered.push_back(b);
+        }
+        for (size_t r = 0; r < registered.size(); ++r) {
+            const LoadedEntry& entry = batch[registered[r]];
+            journalAppend('R', entry.first.timestamp, entry.first.label.c_str(), entry.first.pos,
+                          entry.second.data(), static_cast<long>(entry.second.size()), false);
+        }
+        journalSync();
+        for (size_t r = 0; r < registered.size(); ++r) {
+            const LoadedEntry& entry = batch[registered[r]];
+            entriesAppend('R', entry.first.timestamp, entry.first.label.c_str(), entry.first.pos,
+                          entry.second.data(), static_cast<long>(entry.second.size()));
+        }
+        report->imported += static_cast<long>(registered.size());
+        unsaved += static_cast<long>(registered.size());
+        if (journal_bytes >= JOURNAL_COMPACT_BYTES && saveLocked(handle->modelDir) >= 0) {
+            unsaved = 0;
+        }
+    }
+    close(fd);
+    if (report->imported > 0) {
+        std::lock_guard<std::mutex> lock(sdk_mutex);
+        report->saveResult = saveLocked(handle->modelDir);
+        if (report->saveResult < 0) {
+            noteUnsavedBulk(unsaved);
+        }
+    }
+    report->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<int>(report->imported);
+}
+
+void predictorGetStats(PredictorStats* stats) {
+    for (int s = 0; s < STAT_STAGE_COUNT; ++s) {
+        const StageCounters& counters = stage_counters[s];
+        StageStats& out = stats->stages[s];
+        out.calls = counters.calls.load(std::memory_order_relaxed);
+        out.errors = counters.errors.load(std::memory_order_relaxed);
+        out.totalUs = counters.totalUs.load(std::memory_order_relaxed);
+        out.maxUs = counters.maxUs.load(std::memory_order_relaxed);
+        for (int b = 0; b < STAT_BUCKETS; ++b) {
+            out.buckets[b] = counters.buckets[b].load(std::memory_order_relaxed);
+        }
+    }
+    stats->bytesLoaded = bytes_loaded.load(std::memory_order_relaxed);
+    stats->bytesSaved = bytes_saved.load(std::memory_order_relaxed);
+}
+
+/**
+ * Write the statistics as JSON, including the entries the entry store tracks
+ * per label. Entries registered before the store existed are not counted.
+ * @return length of the full JSON text; the output was truncated if this is >= size
+ */
+int predictorGetStatsJson(char* json, long size) {
+    static const char* const STAGE_NAMES[STAT_STAGE_COUNT] = {
+        "load", "predict", "parse", "regist", "journal", "save", "delete"
+    };
+    PredictorStats stats;
+    predictorGetStats(&stats);
+    std::ostringstream out;
+    out << "{\"stages\": {";
+    for (int s = 0; s < STAT_STAGE_COUNT; ++s) {
+        const StageStats& stage = stats.stages[s];
+        out << (s ? ", " : "") << "\"" << STAGE_NAMES[s] << "\": {\"calls\": " << stage.calls
+            << ", \"errors\": " << stage.errors << ", \"total_us\": " << stage.totalUs
+            << ", \"max_us\": " << stage.maxUs << ", \"histogram_us\": [";
+        for (int b = 0; b < STAT_BUCKETS; ++b) {
+            out << (b ? ", " : "") << stage.buckets[b];
+        }
+        out << "]}";
+    }
+    out << "}, \"bytes_loaded\": " << stats.bytesLoaded << ", \"bytes_saved\": " << stats.bytesSaved
+        << ", \"tracked_entries\": {";
+    {
+        std::lock_guard<std::mutex> lock(sdk_mutex);
+        for (std::map<std::string, std::vector<GalleryRecord> >::const_iterator it = gallery_entries.begin();
+             it != gallery_entries.end(); ++it) {
+            std::string label;
+            for (size_t i = 0; i < it->first.size(); ++i) {
+                if (it->first[i] == '"' || it->first[i] == '\\') {
+                    label += '\\';
+                }
+                label += it->first[i];
+            }
+            out << (it == gallery_entries.begin() ? "" : ", ") << "\"" << label << "\": " << it->second.size();
+        }
+    }
+    out << "}}";
+    std::string text = out.str();
+    if (size > 0) {
+        size_t copied = std::min(text.size(), static_cast<size_t>(size - 1));
+        std::memcpy(json, text.data(), copied);
+        json[copied] = '\0';
+    }
+    return static_cast<int>(text.size());
+}
+
+void predictorResetStats() {
+    for (int s = 0; s < STAT_STAGE_COUNT; ++s) {
+        StageCounters& counters = stage_counters[s];
+        counters.calls.store(0, std::memory_order_relaxed);
+        counters.errors.store(0, std::memory_order_relaxed);
+        counters.totalUs.store(0, std::memory_order_relaxed);
+        counters.maxUs.store(0, std::memory_order_relaxed);
+        for (int b = 0; b < STAT_BUCKETS; ++b) {
+            counters.buckets[b].store(0, std::memory_order_relaxed);
+        }
+    }
+    bytes_loaded.store(0, std::memory_order_relaxed);
+    bytes_saved.store(0, std::memory_order_relaxed);
+}
+
+std::vector<unsigned char> readImage(const std::string& filePath) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open image file: " + filePath);
+    }
+
+    file.seekg(0, std::ios::end);
+    std::streamoff fileSize = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    std::vector<unsigned char> buffer(static_cast<size_t>(fileSize));
+    file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(fileSize));
+    
+    if (!file) {
+        throw std::runtime_error("Failed to read image file: " + filePath);
+    }
+
+    return buffer;
+}
+
+MemoryUsage memoryUsage() {
+    MemoryUsage usage = { 0, 0, 0, 0 };
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        long value = std::atol(line.c_str() + line.find(':') + 1);
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            usage.rssKb = value;
+        } else if (line.compare(0, 8, "RssAnon:") == 0) {
+            usage.anonKb = value;
+        } else if (line.compare(0, 8, "RssFile:") == 0) {
+            usage.fileKb = value;
+        } else if (line.compare(0, 6, "VmHWM:") == 0) {
+            usage.peakKb = value;
+        }
+    }
+    return usage;
+}
+
+// Writing 5 to clear_refs resets VmHWM to the current RSS (Linux 4.0+)
+void resetPeakMemory() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5" << std::endl;
+}
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*) {
+    return remove(path);
+}
+
+// Total size of the regular files below dir, or -1 if dir cannot be read
+long long directorySize(const std::string& dir) {
+    long long bytes = 0;
+    int64_t newestNs = 0;
+    return fileStats(dir, false, &bytes, &newestNs) ? bytes : -1;
+}
+
+void removeDirectory(const std::string& dir) {
+    nftw(dir.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static std::string copy_from;
+static std::string copy_to;
+
+static int copyEntry(const char* path, const struct stat* sb, int typeflag, struct FTW*) {
+    std::string target = copy_to + (path + copy_from.size());
+    if (typeflag == FTW_D) {
+        return mkdir(target.c_str(), sb->st_mode & 0777) == 0 || errno == EEXIST ? 0 : -1;
+    }
+    if (typeflag != FTW_F) {
+        return 0;
+    }
+    FILE* in = fopen(path, "rb");
+    FILE* out = in ? fopen(target.c_str(), "wb") : nullptr;
+    char buffer[65536];
+    size_t n;
+    bool ok = in && out;
+    while (ok && (n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        ok = fwrite(buffer, 1, n, out) == n;
+    }
+    if (in) {
+        fclose(in);
+    }
+    if (out && fclose(out) != 0) {
+        ok = false;
+    }
+    return ok ? 0 : -1;
+}
+
+// Copy the tree below from into the existing directory to; not reentrant
+bool copyDirectory(const std::string& from, const std::string& to) {
+    copy_from = from;
+    copy_to = to;
+    return nftw(from.c_str(), copyEntry, 16, FTW_PHYS) == 0;
+}
+
+/**
+ * List the files of dir/<label>/ for every label sub-directory, in name
+ * order; hidden entries are skipped. files receives (path, label) pairs.
+ * @return false if dir could not be listed
+ */
+bool listLabelFiles(const std::string& dir, std::vector<std::pair<std::string, std::string> >* files) {
+    struct dirent** labels = nullptr;
+    int labelCount = scandir(dir.c_str(), &labels, nullptr, alphasort);
+    if (labelCount < 0) {
+        return false;
+    }
+    for (int i = 0; i < labelCount; ++i) {
+        std::string label = labels[i]->d_name;
+        std::string labelDir = dir + "/" + label;
+        struct stat st;
+        struct dirent** entries = nullptr;
+        int entryCount = -1;
+        if (label[0] != '.' && stat(labelDir.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            entryCount = scandir(labelDir.c_str(), &entries, nullptr, alphasort);
+        }
+        for (int j = 0; j < entryCount; ++j) {
+            std::string path = labelDir + "/" + entries[j]->d_name;
+            if (entries[j]->d_name[0] != '.' && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                files->push_back(std::make_pair(path, label));
+            }
+            free(entries[j]);
+        }
+        free(entries);
+        free(labels[i]);
+    }
+    free(labels);
+    return true;
+}
+
+// Nearest-rank percentile; 0 for an empty sample
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(p / 100.0 * values.size() + 0.5);
+    return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+// Escape text for a JSON string literal
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += text[i];
+        } else if (c < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += text[i];
+        }
+    }
+    return escaped;
+}
+
+/**
+ * Parse a CPU list such as "0,2-3"; false, with cpus empty, if any part is
+ * malformed, a range is reversed, or a CPU is not below CPU_SETSIZE
+ */
+bool parseCpuList(const std::string& list, std::vector<int>* cpus) {
+    cpus->clear();
+    std::stringstream parts(list);
+    std::string part;
+    while (std::getline(parts, part, ',')) {
+        const char* text = part.c_str();
+        char* end = nullptr;
+        long first = std::strtol(text, &end, 10);
+        long last = first;
+        bool valid = end != text;
+        if (valid && *end == '-') {
+            const char* upper = end + 1;
+            last = std::strtol(upper, &end, 10);
+            valid = end != upper;
+        }
+        if (!valid || *end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE) {
+            cpus->clear();
+            return false;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus->push_back(static_cast<int>(cpu));
+        }
+    }
+    return !cpus->empty();
+}
@@ -0,0 +1,261 @@
+/**
+ * @file smart_predictor.h
+ * @brief Client layer over libsmart_predictor_jni.so shared by the Linux demo and tools
+ */
+
+#ifndef SMART_PREDICTOR_H
+#define SMART_PREDICTOR_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <map>
+#include <cstdint>
+
+// Configuration parameters
+const int ASYNC_WORKERS = 2;  // Worker threads serving predictAsync
+const int PREDICT_CANCELLED = -1000;  // Result of an async request superseded by a newer one on its lane
+const int PREDICT_TRUNCATED = -1002;  // Result of a prediction whose JSON outgrew MAX_RESULT_BYTES
+const long MAX_RESULT_BYTES = 1024L * 1024;  // Largest result buffer a growing prediction retries with
+const long JOURNAL_COMPACT_BYTES = 16L * 1024 * 1024;  // Journal size that triggers a save and truncate
+const int AUTOSAVE_INTERVAL_SECONDS = 300;  // Autosave after this long with unsaved registrations
+const int AUTOSAVE_REGISTS = 30;  // Autosave after this many registrations
+const int AUTOSAVE_RETRY_SECONDS = 30;  // Back-off before an autosave is retried after a failure
+const int TOKEN_CACHE_SIZE = 16;  // Recent predictions that can still be registered by token
+const int MAX_SCORES = 16;  // Upper bound on candidates returned by one prediction
+const int IMPORT_QUEUE_DEPTH = 64;  // Images read ahead of the registering thread by predictorImport
+const int IMPORT_BATCH = 32;  // Registrations made per hold of the SDK lock during an import
+const float DUPLICATE_SIMILARITY = 0.95f;  // Score above which predictorCompact treats an entry as a near-duplicate
+const int DEFAULT_MODEL_TYPE = 4;  // model_type of SmartPredictor_load unless SMART_PREDICTOR_MODEL_TYPE is set
+const int STAT_BUCKETS = 16;  // Latency histogram buckets; bucket i counts calls under 2^(i+6) us, the last is open-ended
+
+// Timed stages reported by predictorGetStats()
+enum StatStage {
+    STAT_LOAD,     // SmartPredictor_load, including journal replay
+    STAT_PREDICT,  // SmartPredictor_predict_img: decode, inference, gallery search and JSON formatting
+    STAT_PARSE,    // parseScores
+    STAT_REGIST,   // SmartPredictor_regist_img
+    STAT_JOURNAL,  // Journal append and fdatasync
+    STAT_SAVE,     // SmartPredictor_save
+    STAT_DELETE,   // SmartPredictor_delete
+    STAT_STAGE_COUNT
+};
+
+// Counters of one stage
+struct StageStats {
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t totalUs;
+    uint64_t maxUs;
+    uint64_t buckets[STAT_BUCKETS];
+};
+
+// Snapshot of the client layer counters
+struct PredictorStats {
+    StageStats stages[STAT_STAGE_COUNT];
+    uint64_t bytesLoaded;  // Size of the SDK's files in the model directory at each load
+    uint64_t bytesSaved;   // Size of the SDK's files in the model directory after each save
+};
+
+// One prediction candidate; the label text is looked up with labelName()
+struct PredictScore {
+    int labelId;
+    float score;
+};
+
+/**
+ * Predictor session handle. The SDK keeps one model per process, so every
+ * handle shares the same loaded weights: the first handle loads the model
+ * and the last one destroyed unloads it. All calls through handles are
+ * serialized, which makes it safe to predict, register, save and delete
+ * from several threads on one or more handles.
+ */
+struct SmartPredictor {
+    std::string modelDir;
+};
+
+// Resident memory of this process in kB, from /proc/self/status
+struct MemoryUsage {
+    long rssKb;
+    long anonKb;  // Private heap/stack pages
+    long fileKb;  // File-backed pages, shareable through the page cache
+    long peakKb;  // High-water mark of rssKb since start or resetPeakMemory()
+};
+
+// Progress of background saves, see predictorSaveStatus()
+struct SaveStatus {
+    bool running;        // A save is queued or being written
+    long completed;      // Background saves finished since start-up
+    int lastResult;      // SmartPredictor_save result of the last background save
+    int pendingRegists;  // Registrations and deletes not yet saved
+};
+
+// A file predictorImport could not register
+struct ImportFailure {
+    std::string path;
+    int result;  // SmartPredictor_regist_img result, or -1 if the file could not be read
+};
+
+// Outcome of predictorImport
+struct ImportReport {
+    long files;       // Images found under the import directory
+    long imported;    // Images registered
+    double seconds;   // Wall time including the final save
+    int saveResult;   // SmartPredictor_save result of the final save
+    std::vector<ImportFailure> failures;
+};
+
+// Outcome of predictorCompact
+struct CompactReport {
+    long entriesBefore;  // Tracked entries of the compacted labels
+    long entriesAfter;
+    long duplicates;     // Entries dropped as near-duplicates of a newer entry
+    long evicted;        // Entries dropped because the label was over its cap
+    long skippedLabels;  // Labels left alone: the entry store may not hold all their entries
+    int saveResult;      // SmartPredictor_save result of the save that ends the compaction
+};
+
+// Label with the number of entries the entry store tracks for it; see predictorListLabels()
+struct LabelCount {
+    int labelId;  // Interned id, see internLabel()
+    std::string label;
+    long samples;
+};
+
+// Outcome of predictorMergeGallery
+struct MergeReport {
+    long records;     // Entries in the export file
+    long imported;    // Entries registered into the live model
+    long duplicates;  // Entries whose image the label already had
+    long unmapped;    // Entries of labels the label map drops
+    long failed;      // Entries that were corrupt or that SmartPredictor_regist_img rejected
+    double seconds;   // Wall time including the final save
+    int saveResult;   // SmartPredictor_save result, when anything was imported
+};
+
+// How idle SDK worker threads wait for the next parallel region
+enum SpinPolicy {
+    SPIN_DEFAULT,  // Leave the runtime's own setting
+    SPIN_ACTIVE,   // Busy-wait: lowest latency, burns the cores between frames
+    SPIN_PASSIVE   // Sleep: frees the cores for the POS UI and camera threads
+};
+
+/**
+ * Threading of the SDK's inference runtime, see predictorConfigureThreads().
+ * The SDK keeps one pool per process, shared by every handle; run the
+ * daemon to share one pool between processes as well.
+ */
+struct ThreadConfig {
+    int threads;            // Inference threads; 0 keeps the SDK default
+    std::vector<int> cpus;  // Cores the SDK may run on; empty means no pinning
+    SpinPolicy spin;
+};
+
+// Result of a predictAsync request
+struct PredictCompletion {
+    long requestId;
+    int lane;
+    int result;        // SmartPredictor_predict_img result, PREDICT_CANCELLED or PREDICT_TRUNCATED
+    std::string json;  // Prediction content when result >= 0
+};
+
+// Completion callback; runs on an async worker thread
+using PredictCallback = void(*)(const PredictCompletion& completion, void* userData);
+
+// Function pointers
+using SmartPredictor_load = int(*)(const char*, int);
+using SmartPredictor_unload = int(*)();
+using SmartPredictor_predict_img = int(*)(unsigned char*, long, float, char*, long);
+using SmartPredictor_regist_img = int(*)(unsigned char*, long, const char*, int);
+using SmartPredictor_save = int(*)(const char*);
+using SmartPredictor_reset = bool(*)(const char*);
+using SmartPredictor_delete = bool(*)(const char*);
+using SmartPredictor_sign = int(*)(const char*, const char*);
+
+extern void* lib_handle;
+extern SmartPredictor_load load_func;
+extern SmartPredictor_unload unload_func;
+extern SmartPredictor_predict_img predict_func;
+extern SmartPredictor_regist_img regist_func;
+extern SmartPredictor_save save_func;
+extern SmartPredictor_reset reset_func;
+extern SmartPredictor_delete delete_func;
+extern SmartPredictor_sign sign_func;
+
+// Serializes every SDK call; hold it when calling the function pointers directly
+extern std::mutex sdk_mutex;
+extern int journal_replayed;  // Records replayed by the last model load
+
+// SDK library
+bool loadLibrary();
+bool getFunctionPointers();
+
+// Predictor sessions
+SmartPredictor* predictorCreate(const char* modelDir, int modelType);
+void predictorDestroy(SmartPredictor* handle);
+int predictorPredict(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, float filterSim,
+                     char* result, long resultSize);
+int predictorRegist(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, const char* label, int pos);
+int predictorSave(SmartPredictor* handle);
+int predictorSaveCopy(SmartPredictor* handle, const char* modelDir);
+void predictorSaveAsync(SmartPredictor* handle);
+SaveStatus predictorSaveStatus();
+void predictorSetAutosave(int intervalSeconds, int registCount);
+void predictorSaveShutdown();
+bool predictorReset(const char* modelDir);
+bool predictorEnableEntryStore(const char* modelDir);
+bool predictorDelete(SmartPredictor* handle, const char* label);
+int predictorRenameLabel(SmartPredictor* handle, const char* from, const char* to);
+void predictorListLabels(std::vector<LabelCount>* labels);
+void predictorSetLabelCap(const char* label, int cap);
+int predictorCompact(SmartPredictor* handle, const char* label, CompactReport* report);
+long predictorExportGallery(SmartPredictor* handle, const char* path, long long sinceMs);
+int predictorMergeGallery(SmartPredictor* handle, const char* path,
+                          const std::map<std::string, std::string>& labelMap, MergeReport* report);
+int predictorImport(SmartPredictor* handle, const char* imageDir, int pos, int readers, ImportReport* report);
+int predictorWarmup(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, int rounds);
+
+// Inference threading
+bool predictorConfigureThreads(const ThreadConfig& config);
+ThreadConfig predictorThreadConfig();
+bool threadConfigFromEnv(ThreadConfig* config);
+bool parseModelType(const char* text, int* modelType);
+int modelTypeFromEnv();
+
+// Statistics
+void predictorGetStats(PredictorStats* stats);
+int predictorGetStatsJson(char* json, long size);
+void predictorResetStats();
+
+// Prediction helpers
+int predictBatch(SmartPredictor* handle, unsigned char** imgBytes, const long* byteSizes, int count, float filterSim,
+                 char** results, long resultSize, int* codes);
+int predictWithToken(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, float filterSim,
+                     char* result, long resultSize, long* token);
+int registByToken(SmartPredictor* handle, long token, const char* label, int pos);
+int parseScores(const char* json, PredictScore* scores, int maxScores, int* scoreCount);
+int predictScores(SmartPredictor* handle, unsigned char* imgBytes, long byteSize, float filterSim,
+                  PredictScore* scores, int maxScores, int* scoreCount, int* totalCount = nullptr);
+int internLabel(const std::string& label);
+const char* labelName(int labelId);
+
+// Asynchronous prediction
+long predictAsync(SmartPredictor* handle, int lane, const unsigned char* imgBytes, long byteSize,
+                  float filterSim, PredictCallback callback, void* userData);
+int predictAsyncFd();
+bool predictAsyncPoll(PredictCompletion* completion);
+void predictAsyncShutdown();
+
+// Utilities
+std::vector<unsigned char> readImage(const std::string& filePath);
+MemoryUsage memoryUsage();
+void resetPeakMemory();
+long long directorySize(const std::string& dir);
+void removeDirectory(const std::string& dir);
+bool copyDirectory(const std::string& from, const std::string& to);
+bool listLabelFiles(const std::string& dir, std::vector<std::pair<std::string, std::string> >* files);
+double percentile(std::vector<double> values, double p);
+std::string jsonEscape(const std::string& text);
+bool parseCpuList(const std::string& list, std::vector<int>* cpus);
+
+#endif // SMART_PREDICTOR_H